@@ -0,0 +1,85 @@
+// Account lookup latency vs. account count.
+// Compares the hashed account index against the old linear scan of accounts[],
+// and reports the slowest single insert (the index grows incrementally, so
+// this should stay in the microseconds even at 10M accounts).
+//
+// Usage: bench_account_lookup [max_accounts]   (default 10000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../c_backend/hash_index.h"
+
+#define LOOKUPS 2000000
+#define LINEAR_SCAN_LIMIT 100000 // beyond this the linear scan takes minutes
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t rng_state = 2463534242u;
+static uint32_t xorshift32(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+int main(int argc, char** argv)
+{
+    long max_n = (argc > 1) ? atol(argv[1]) : 10000000L;
+    int* ids = (int*)malloc(sizeof(int) * (size_t)max_n);
+    if (ids == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    // Account IDs look like the ones the UI hands out (6-9 digits, not contiguous).
+    for (long i = 0; i < max_n; i++)
+        ids[i] = 100000 + (int)(i * 7);
+
+    printf("%12s %18s %18s %16s\n", "accounts", "hashed ns/lookup", "linear ns/lookup", "max insert us");
+
+    long sink = 0;
+    for (long n = 1000; n <= max_n; n *= 10) {
+        hash_index idx;
+        hash_index_init(&idx);
+        double worst_insert = 0;
+        for (long i = 0; i < n; i++) {
+            double t = now_sec();
+            hash_index_insert(&idx, ids[i], (uint32_t)i);
+            t = now_sec() - t;
+            if (t > worst_insert) worst_insert = t;
+        }
+
+        double t0 = now_sec();
+        for (long i = 0; i < LOOKUPS; i++) {
+            uint32_t pos;
+            if (hash_index_find(&idx, ids[xorshift32() % n], &pos) == 0)
+                sink += pos;
+        }
+        double hashed_ns = (now_sec() - t0) * 1e9 / LOOKUPS;
+
+        char linear[32] = "-";
+        if (n <= LINEAR_SCAN_LIMIT) {
+            long lookups = LOOKUPS / (n / 1000);
+            t0 = now_sec();
+            for (long i = 0; i < lookups; i++) {
+                int key = ids[xorshift32() % n];
+                for (long j = 0; j < n; j++) {
+                    if (ids[j] == key) { sink += j; break; }
+                }
+            }
+            snprintf(linear, sizeof(linear), "%.1f", (now_sec() - t0) * 1e9 / lookups);
+        }
+        printf("%12ld %18.1f %18s %16.1f\n", n, hashed_ns, linear, worst_insert * 1e6);
+        hash_index_free(&idx);
+    }
+
+    free(ids);
+    return sink == 42 ? 1 : 0; // keep 'sink' alive
+}
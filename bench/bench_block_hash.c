@@ -0,0 +1,204 @@
+// Block hashing cost: the old djb2-over-snprintf block hash against SHA-256
+// over the binary block encoding, for each SHA-256 engine this CPU supports.
+// "single" hashes one block at a time (what sealing does); "x8" hashes eight
+// blocks per sha256_many() call (what chain validation does). The encodings
+// mirror backend.c; it hashes each transaction as a Merkle leaf rather than
+// one long message, but the bytes through the engine are about the same.
+//
+// Usage: bench_block_hash [blocks_per_run]   (default 20000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../c_backend/sha256.h"
+
+#define HASH_STR_LEN 65
+#define TX_RECORD_MAX (4 * 4 + 8 + 1 + 100)
+
+typedef struct Transaction {
+    int txID;
+    int fromAcc;
+    int toAcc;
+    float amount;
+    char remark[100];
+    int64_t timestamp;
+} Transaction;
+
+typedef struct Block {
+    int index;
+    int64_t timestamp;
+    int transactionCount;
+    Transaction* transactions;
+    unsigned char previousHash[SHA256_DIGEST_LEN];
+    char previousHex[HASH_STR_LEN]; // what the old layout stored and hashed
+} Block;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// ---- The old hash ----
+
+static unsigned long djb2_update(unsigned long hash, const char* str)
+{
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + (unsigned char)c;
+    return hash;
+}
+
+static void djb2_block(const Block* blk, char out[HASH_STR_LEN])
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%d|%lld|%s|", blk->index, (long long)blk->timestamp, blk->previousHex);
+    unsigned long h = djb2_update(5381, buf);
+    for (int i = 0; i < blk->transactionCount; i++) {
+        const Transaction* t = &blk->transactions[i];
+        snprintf(buf, sizeof(buf), "%d:%d->%d:%.2f:%lld|", t->txID, t->fromAcc, t->toAcc, t->amount, (long long)t->timestamp);
+        h = djb2_update(h, buf);
+    }
+    sprintf(out, "%lx", h);
+}
+
+// ---- The new encoding ----
+
+static unsigned char* put_le32(unsigned char* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 4;
+}
+
+static unsigned char* put_le64(unsigned char* p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 8;
+}
+
+static size_t encode_block(const Block* blk, unsigned char* out)
+{
+    unsigned char* p = put_le32(out, (uint32_t)blk->index);
+    p = put_le64(p, (uint64_t)blk->timestamp);
+    p = put_le32(p, (uint32_t)blk->transactionCount);
+    memcpy(p, blk->previousHash, SHA256_DIGEST_LEN);
+    p += SHA256_DIGEST_LEN;
+    for (int i = 0; i < blk->transactionCount; i++) {
+        const Transaction* t = &blk->transactions[i];
+        uint32_t amountBits;
+        memcpy(&amountBits, &t->amount, sizeof(amountBits));
+        size_t remarkLen = strlen(t->remark);
+        p = put_le32(p, (uint32_t)t->txID);
+        p = put_le32(p, (uint32_t)t->fromAcc);
+        p = put_le32(p, (uint32_t)t->toAcc);
+        p = put_le32(p, amountBits);
+        p = put_le64(p, (uint64_t)t->timestamp);
+        *p++ = (unsigned char)remarkLen;
+        memcpy(p, t->remark, remarkLen);
+        p += remarkLen;
+    }
+    return (size_t)(p - out);
+}
+
+static const char* engine_label(int engine)
+{
+    return engine == SHA256_SHANI ? "sha-ni" : engine == SHA256_AVX2 ? "avx2" : "portable";
+}
+
+int main(int argc, char** argv)
+{
+    long blocks = (argc > 1) ? atol(argv[1]) : 20000L;
+    static const int txPerBlock[] = {1, 64, 1024};
+
+    printf("%8s %-10s %14s %14s %14s\n", "tx/block", "hash", "ns/block", "ns/tx", "MB/s encoded");
+
+    long sink = 0;
+    for (size_t s = 0; s < sizeof(txPerBlock) / sizeof(txPerBlock[0]); s++) {
+        int txs = txPerBlock[s];
+        long runs = blocks / txs > 64 ? blocks / txs : 64;
+
+        Block blk[SHA256_LANES];
+        unsigned char* enc[SHA256_LANES];
+        size_t encLen[SHA256_LANES];
+        for (int b = 0; b < SHA256_LANES; b++) {
+            blk[b].index = b + 1;
+            blk[b].timestamp = 1700000000000000LL + b;
+            blk[b].transactionCount = txs;
+            for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+                blk[b].previousHash[i] = (unsigned char)(i * 37 + b);
+                sprintf(blk[b].previousHex + 2 * i, "%02x", blk[b].previousHash[i]);
+            }
+            blk[b].transactions = (Transaction*)calloc((size_t)txs, sizeof(Transaction));
+            enc[b] = (unsigned char*)malloc(128 + TX_RECORD_MAX * (size_t)txs);
+            if (blk[b].transactions == NULL || enc[b] == NULL) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+            for (int i = 0; i < txs; i++) {
+                Transaction* t = &blk[b].transactions[i];
+                t->txID = b * txs + i + 1;
+                t->fromAcc = 100000 + i;
+                t->toAcc = 200000 + i;
+                t->amount = 12.5f + (float)i;
+                snprintf(t->remark, sizeof(t->remark), "Transfer %d->%d", t->fromAcc, t->toAcc);
+                t->timestamp = blk[b].timestamp + i;
+            }
+        }
+
+        char hex[HASH_STR_LEN];
+        double t0 = now_sec();
+        for (long r = 0; r < runs; r++) {
+            djb2_block(&blk[r % SHA256_LANES], hex);
+            sink += hex[0];
+        }
+        double ns = (now_sec() - t0) * 1e9 / (double)runs;
+        printf("%8d %-10s %14.0f %14.1f %14s\n", txs, "djb2", ns, ns / txs, "-");
+
+        for (int engine = SHA256_PORTABLE; engine <= SHA256_SHANI; engine++) {
+            if (sha256_use_engine(engine) != 0) continue;
+
+            unsigned char digest[SHA256_LANES][SHA256_DIGEST_LEN];
+            size_t bytes = 0;
+            t0 = now_sec();
+            for (long r = 0; r < runs; r++) {
+                int b = (int)(r % SHA256_LANES);
+                encLen[b] = encode_block(&blk[b], enc[b]);
+                sha256(enc[b], encLen[b], digest[b]);
+                bytes += encLen[b];
+                sink += digest[b][0];
+            }
+            double secs = now_sec() - t0;
+            ns = secs * 1e9 / (double)runs;
+            char label[32];
+            snprintf(label, sizeof(label), "%s", engine_label(engine));
+            printf("%8d %-10s %14.0f %14.1f %14.0f\n", txs, label, ns, ns / txs, (double)bytes / secs / 1e6);
+
+            // Eight blocks per call; the encoding is the same, so time only the hashing.
+            for (int b = 0; b < SHA256_LANES; b++)
+                encLen[b] = encode_block(&blk[b], enc[b]);
+            long groups = runs / SHA256_LANES > 8 ? runs / SHA256_LANES : 8;
+            bytes = 0;
+            t0 = now_sec();
+            for (long r = 0; r < groups; r++) {
+                sha256_many((const unsigned char* const*)enc, encLen, SHA256_LANES, digest);
+                for (int b = 0; b < SHA256_LANES; b++) bytes += encLen[b];
+                sink += digest[0][0];
+            }
+            secs = now_sec() - t0;
+            ns = secs * 1e9 / (double)(groups * SHA256_LANES);
+            snprintf(label, sizeof(label), "%s x8", engine_label(engine));
+            printf("%8d %-10s %14.0f %14.1f %14.0f\n", txs, label, ns, ns / txs, (double)bytes / secs / 1e6);
+        }
+
+        for (int b = 0; b < SHA256_LANES; b++) {
+            free(blk[b].transactions);
+            free(enc[b]);
+        }
+    }
+
+    printf("(checksum %ld)\n", sink);
+    return 0;
+}
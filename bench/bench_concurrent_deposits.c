@@ -0,0 +1,102 @@
+// Multi-threaded deposit throughput: the scaling curve of the striped
+// per-account locks (or of the single-writer sequencer) as worker threads
+// are added.
+//
+// Usage: bench_concurrent_deposits [deposits_per_run] [max_threads] [locks|sequencer] [block_max_tx]
+//        (defaults: 200000 deposits, 2x the CPU count, locks, 1 transaction per block)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../c_backend/backend.h"
+#include "../c_backend/platform.h"
+
+#define ACCOUNTS 100000
+#define FIRST_ID 100000
+
+typedef struct worker {
+    long deposits;
+    uint32_t seed;
+    long failures;
+} worker;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run_worker(void* arg)
+{
+    worker* w = (worker*)arg;
+    uint32_t x = w->seed;
+    for (long i = 0; i < w->deposits; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if (perform_deposit(FIRST_ID + (int)(x % ACCOUNTS), 1.0f) != 0)
+            w->failures++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long per_run = (argc > 1) ? atol(argv[1]) : 200000L;
+    int max_threads = (argc > 2) ? atoi(argv[2]) : 2 * pbl_cpu_count();
+    const char* mode = (argc > 3) ? argv[3] : "locks";
+    int block_max_tx = (argc > 4) ? atoi(argv[4]) : 1;
+
+    for (int i = 0; i < ACCOUNTS; i++) {
+        if (perform_create_account(FIRST_ID + i, "Bench", "5550000000", 0.0f) != 0) {
+            fprintf(stderr, "could not create account %d\n", FIRST_ID + i);
+            return 1;
+        }
+    }
+
+    if (set_block_policy(block_max_tx, 0, 0) != 0) {
+        fprintf(stderr, "invalid block size %d\n", block_max_tx);
+        return 1;
+    }
+    if (strcmp(mode, "sequencer") == 0) {
+        if (start_sequencer(pbl_cpu_count() - 1) != 0) {
+            fprintf(stderr, "could not start the sequencer\n");
+            return 1;
+        }
+    } else {
+        mode = "locks";
+    }
+
+    printf("%d CPUs, %d accounts, %ld deposits per run, %s, %d tx/block\n",
+           pbl_cpu_count(), ACCOUNTS, per_run, mode, block_max_tx);
+    printf("%8s %14s %10s\n", "threads", "deposits/sec", "speedup");
+
+    double base = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        pbl_thread* ids = (pbl_thread*)malloc(sizeof(pbl_thread) * threads);
+        worker* workers = (worker*)calloc(threads, sizeof(worker));
+        for (int t = 0; t < threads; t++) {
+            workers[t].deposits = per_run / threads;
+            workers[t].seed = 2463534242u + (uint32_t)t * 7919u;
+        }
+
+        double t0 = now_sec();
+        for (int t = 0; t < threads; t++)
+            pbl_thread_start(&ids[t], run_worker, &workers[t]);
+        long failures = 0;
+        for (int t = 0; t < threads; t++) {
+            pbl_thread_join(ids[t]);
+            failures += workers[t].failures;
+        }
+        double rate = (double)(per_run / threads * threads) / (now_sec() - t0);
+        if (threads == 1) base = rate;
+
+        printf("%8d %14.0f %9.2fx%s\n", threads, rate, rate / base, failures ? "  (failures!)" : "");
+        free(ids);
+        free(workers);
+    }
+    stop_sequencer();
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Durable deposit throughput with the ledger log's group commit: as worker
+// threads are added, each write + fdatasync covers more sealed blocks, so
+// throughput grows although every deposit still waits for its block to be
+// on disk. "blocks/flush" is how many blocks one group commit covered.
+//
+// Run it in an empty scratch directory: it calls initialize_system(), so it
+// appends to ./ledger.log and leaves accounts.dat / users.dat behind.
+//
+// Usage: bench_ledger_commit [deposits_per_thread] [max_threads] [full|write]
+//        (defaults: 2000 deposits, 64 threads, full = fdatasync)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../c_backend/backend.h"
+#include "../c_backend/platform.h"
+
+#define ACCOUNTS 1000
+#define FIRST_ID 100000
+#define MAX_THREADS 256
+
+typedef struct worker {
+    int first;
+    long deposits;
+    long failures;
+} worker;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run_worker(void* arg)
+{
+    worker* w = (worker*)arg;
+    for (long i = 0; i < w->deposits; i++) {
+        if (perform_deposit(FIRST_ID + (int)((w->first + i) % ACCOUNTS), 1.0f) != 0)
+            w->failures++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    long per_thread = (argc > 1) ? atol(argv[1]) : 2000L;
+    int max_threads = (argc > 2) ? atoi(argv[2]) : 64;
+    const char* mode = (argc > 3) ? argv[3] : "full";
+    if (max_threads < 1 || max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+
+    if (set_ledger_sync(strcmp(mode, "write") == 0 ? LEDGER_SYNC_WRITE : LEDGER_SYNC_FULL) != 0) return 1;
+    initialize_system();
+    long long blocks = 0, flushes = 0;
+    if (get_ledger_log_stats(&blocks, &flushes, NULL) != 0) {
+        fprintf(stderr, "could not open ledger.log\n");
+        return 1;
+    }
+    for (int i = 0; i < ACCOUNTS; i++) {
+        if (perform_create_account(FIRST_ID + i, "Bench", "5550000000", 0.0f) == 2) {
+            fprintf(stderr, "could not create account %d\n", FIRST_ID + i);
+            return 1;
+        }
+    }
+
+    printf("ledger sync: %s, %ld deposits per thread, %lld blocks already logged\n", mode, per_thread, blocks);
+    printf("%8s %14s %12s %14s\n", "threads", "deposits/s", "flushes", "blocks/flush");
+
+    worker workers[MAX_THREADS];
+    pbl_thread threads[MAX_THREADS];
+    for (int n = 1; n <= max_threads; n *= 2) {
+        long long blocks0 = 0, flushes0 = 0;
+        get_ledger_log_stats(&blocks0, &flushes0, NULL);
+
+        double t0 = now_sec();
+        int started = 0;
+        for (int i = 0; i < n; i++) {
+            workers[i].first = i * 7;
+            workers[i].deposits = per_thread;
+            workers[i].failures = 0;
+            if (pbl_thread_start(&threads[i], run_worker, &workers[i]) != 0) break;
+            started++;
+        }
+        long failures = 0;
+        for (int i = 0; i < started; i++) {
+            pbl_thread_join(threads[i]);
+            failures += workers[i].failures;
+        }
+        double secs = now_sec() - t0;
+
+        get_ledger_log_stats(&blocks, &flushes, NULL);
+        long long runFlushes = flushes - flushes0;
+        printf("%8d %14.0f %12lld %14.1f%s\n", started, (double)started * per_thread / secs, runFlushes,
+               runFlushes > 0 ? (double)(blocks - blocks0) / (double)runFlushes : 0.0,
+               failures ? "  (failures!)" : "");
+    }
+
+    shutdown_system();
+    return 0;
+}
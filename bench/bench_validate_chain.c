@@ -0,0 +1,81 @@
+// Chain validation time vs. chain length. "audit" re-hashes the whole chain
+// (audit_chain()) with one validation thread and with N; "routine" is
+// find_invalid_block() after the chain grew, which only hashes the new blocks.
+// Blocks hold one deposit each (the default policy), so the chain is as long
+// as it can get for a given number of transactions.
+//
+// Usage: bench_validate_chain [max_blocks] [threads]   (defaults: 1000000, one per CPU)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../c_backend/backend.h"
+#include "../c_backend/platform.h"
+
+#define ACCOUNTS 1000
+#define FIRST_ID 100000
+#define APPENDED 100 // blocks added between routine checks
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int add_blocks(long* blocks, long target)
+{
+    for (; *blocks < target; (*blocks)++) {
+        if (perform_deposit(FIRST_ID + (int)(*blocks % ACCOUNTS), 1.0f) != 0) {
+            fprintf(stderr, "deposit %ld failed\n", *blocks);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double time_audit(int threads, int* bad)
+{
+    set_validation_threads(threads);
+    double t0 = now_sec();
+    int b = audit_chain();
+    if (b >= 0) *bad = b;
+    return now_sec() - t0;
+}
+
+int main(int argc, char** argv)
+{
+    long max_blocks = (argc > 1) ? atol(argv[1]) : 1000000L;
+    int threads = (argc > 2) ? atoi(argv[2]) : pbl_cpu_count();
+
+    for (int i = 0; i < ACCOUNTS; i++) {
+        if (perform_create_account(FIRST_ID + i, "Bench", "5550000000", 0.0f) != 0) {
+            fprintf(stderr, "could not create account %d\n", FIRST_ID + i);
+            return 1;
+        }
+    }
+
+    printf("%d CPUs, auditing with 1 and %d threads, routine check after %d new blocks\n",
+           pbl_cpu_count(), threads, APPENDED);
+    printf("%10s %14s %14s %10s %14s\n", "blocks", "audit 1 ms", "audit N ms", "speedup", "routine ms");
+
+    long blocks = 0;
+    for (long target = 1000; target <= max_blocks; target *= 10) {
+        if (add_blocks(&blocks, target) != 0) return 1;
+
+        int bad = -1;
+        double one = time_audit(1, &bad);
+        double many = time_audit(threads, &bad);
+
+        if (add_blocks(&blocks, target + APPENDED) != 0) return 1;
+        double t0 = now_sec();
+        int b = find_invalid_block();
+        double routine = now_sec() - t0;
+        if (b >= 0) bad = b;
+
+        printf("%10ld %14.1f %14.1f %9.2fx %14.3f%s\n", target, one * 1e3, many * 1e3, one / many,
+               routine * 1e3, bad >= 0 ? "  (invalid chain!)" : "");
+    }
+    return 0;
+}
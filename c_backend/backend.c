@@ -1,19 +1,57 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include "backend.h"
-
-#define max_user 1000
-#define max_accounts 1000
+#include "hash_index.h"
+#include "mapped_file.h"
+#include "mpsc_ring.h"
+#include "ordered_set.h"
+#include "platform.h"
+#include "record_log.h"
+#include "seg_array.h"
+#include "sha256.h"
+#include "timestamp.h"
 
 // ------------------------------------------- STRUCTURES -------------------------------------------------------
 // Note: 'account' struct is now defined in the header file
 //       so we don't need to define it here.
 
-account *accounts[max_accounts];
+// Accounts live in a slab of fixed-size chunks. A slot handle (index into the
+// slab) stays valid for the lifetime of the account; deleted slots go on a
+// free list and are handed out again by the next create. Growing the slab
+// adds one chunk and never moves existing accounts.
+//
+// The slab is normally a private mapping of accounts.dat (see ACCOUNTS FILE),
+// so startup does not copy the accounts; updates stay in memory until a
+// checkpoint writes them back. Slots are padded to ACCOUNT_SLOT_BYTES so
+// none straddles a page.
+#define SLAB_NO_SLOT 0xFFFFFFFFu
+#define ACCOUNT_SLOT_BYTES 128
+
+typedef struct account_slot {
+    account acc;
+    int live;          // 1 = holds an account, 0 = on the free list
+    uint32_t nextFree; // next free slot (only meaningful when !live)
+    int historyFrom;   // first txID in the account's statement (see ACCOUNT HISTORY)
+    char pad[ACCOUNT_SLOT_BYTES - sizeof(account) - 3 * sizeof(int)];
+} account_slot;
+
+typedef char account_slot_size_check[sizeof(account_slot) == ACCOUNT_SLOT_BYTES ? 1 : -1];
+
+static seg_array accountSlab = { NULL, sizeof(account_slot), 0, NULL, 0 };
+static uint32_t slabUsed = 0; // slots [0, slabUsed) have been handed out at least once
+static uint32_t slabFreeHead = SLAB_NO_SLOT;
 int accountcount = 0;
+static mapped_file accountsFile;
+static int accountsMapped = 0; // 1 while accountSlab is accountsFile's mapping
+
+// accID -> slab handle; kept in sync by create/delete/load.
+static hash_index accountIndex;
+
+// Every account ID in ascending order, for listing accounts page by page.
+static ordered_set accountOrder;
 
 typedef struct
 {
@@ -22,15 +60,43 @@ typedef struct
     char password[50];
 } user;
 
-user users[max_user];
+static seg_array userTable = { NULL, sizeof(user), 0, NULL, 0 };
 int usercount = 0;
 
+// user ID -> row in userTable; also how perform_register() spots duplicates.
+static hash_index userIndex;
+
+// Every account and user mutation is also appended to the state log (see
+// STATE LOG); accounts.dat and users.dat are the snapshots it replays onto.
+#define STATE_LOG_FILE "state.wal"
+#define STATE_LOG_OLD "state.wal.old" // records the checkpoint in progress still needs
+static record_log stateLog;
+static volatile int64_t stateOpen = 0; // 1 while stateLog takes records
+static int stateCorrupt = 0;            // set by initialize_system() if a state log would not replay
+
+// Optional cap on the bytes used by the account/user tables, their indexes
+// and the pending pool (0 = unlimited). Ledger blocks are not counted.
+// Each table publishes its own usage so the check never needs another table's lock.
+static volatile int64_t memoryBudget = 0;
+static volatile int64_t accountsBytes = 0;
+static volatile int64_t usersBytes = 0;
+static volatile int64_t pendingBytes = 0;
+
 // ------------------------------------------- BLOCKCHAIN STRUCTURES --------------------------------------------
 
-// --- FIX APPLIED HERE: Changed from 5 to 1 for instant mining ---
-#define BLOCK_CAP 1  
-#define MAX_PENDING 1000
-#define HASH_STR_LEN 65
+// Block sealing policy (set_block_policy()). A block is sealed once
+// blockMaxTx transactions are pending, once the oldest pending one is
+// blockMaxDelayMs old, or once it would exceed blockMaxBytes of
+// transactions. The default of one transaction per block seals instantly.
+#define DEFAULT_BLOCK_MAX_TX 1
+#define PENDING_RING_SIZE 16384 // also the most transactions a sealed block can take from it
+#define HASH_STR_LEN 65 // hex digest + terminator, only built when rendering
+
+// A SHA-256 digest held as four 64-bit words, so comparing two is four XORs
+// and one branch.
+typedef struct block_hash {
+    uint64_t w[SHA256_DIGEST_LEN / 8];
+} block_hash;
 
 typedef struct Transaction {
     int txID;
@@ -38,16 +104,19 @@ typedef struct Transaction {
     int toAcc;
     float amount;
     char remark[100];
-    char timestamp[30];
+    int64_t timestamp; // microseconds since the epoch; formatted only for display
 } Transaction;
 
+// Holds up to block_capacity() transactions (a batch may fill a block up to
+// the byte cap alone). The transactions live right after the block in the same allocation.
 typedef struct Block {
     int index;
-    char timestamp[30];
+    int64_t timestamp; // microseconds since the epoch, taken when the block is sealed
     int transactionCount;
-    Transaction transactions[BLOCK_CAP];
-    char previousHash[HASH_STR_LEN];
-    char currHash[HASH_STR_LEN];
+    Transaction *transactions;
+    block_hash previousHash; // all zeros for the genesis block
+    block_hash merkleRoot;   // over transactions[]; see MERKLE TREES
+    block_hash currHash;
     struct Block* next;
 } Block;
 
@@ -55,183 +124,2345 @@ Block* blockchainHead = NULL;
 Block* blockchainTail = NULL;
 int blockCount = 0;
 
-Transaction pendingPool[MAX_PENDING];
-int pendingCount = 0;
-int nextTxID = 1;
+// Every linked block is also appended to the ledger log (see LEDGER LOG),
+// which initialize_system() replays to rebuild the chain.
+#define LEDGER_FILE "ledger.log"
+static record_log ledgerLog;
+static volatile int64_t ledgerOpen = 0;                   // 1 while ledgerLog takes blocks
+static int ledgerCorrupt = 0;                             // set by initialize_system() if ledger.log would not replay
+static volatile int64_t ledgerSyncMode = LEDGER_SYNC_FULL;
+
+typedef char ledger_sync_write_check[LEDGER_SYNC_WRITE == RECORD_LOG_WRITE ? 1 : -1];
+typedef char ledger_sync_full_check[LEDGER_SYNC_FULL == RECORD_LOG_SYNC ? 1 : -1];
+
+// Blocks that passed validation, from genesis on (see CHAIN VALIDATION).
+static int64_t verifiedCount = 0;
+static Block* verifiedTail = NULL;             // block verifiedCount - 1
+static block_hash verifiedDigest;              // rolling digest of the prefix; zeros when empty
+static block_hash* verifiedCheckpoints = NULL; // [k] = the digest after (k + 1) * VALIDATE_CHUNK blocks
+static int64_t checkpointCap = 0;
+
+// Transactions recorded but not yet sealed, oldest first. Producers push
+// without a lock; only the thread holding chainLock pops (see SEALING).
+// A transaction gets its txID when it is sealed, so IDs follow chain order.
+static mpsc_ring pendingRing;
+static volatile int64_t pendingRingState = 0; // 0 = not allocated, 1 = being allocated, 2 = ready, 3 = failed
+static volatile int64_t pendingSince = 0;     // pbl_now_ms() when the oldest pending transaction arrived (0 = none)
+int nextTxID = 1;                             // owned by whoever holds chainLock
+
+// Ring tickets below sealedThrough are in linked blocks (see await_sealed()).
+static volatile int64_t sealedThrough = 0;    // written by whoever holds chainLock
+static volatile int64_t sealWaiters = 0;      // threads in await_sealed() sleeping on sealedCond
+static pbl_mutex sealedLock = PBL_MUTEX_INIT;
+static pbl_cond sealedCond = PBL_COND_INIT;
+
+static volatile int64_t blockMaxTx = DEFAULT_BLOCK_MAX_TX;
+static volatile int64_t blockMaxDelayMs = 0; // 0 = no time trigger
+static volatile int64_t blockMaxBytes = 0;   // 0 = no byte cap
+
+// ------------------------------------------- CONCURRENCY -------------------------------------------------------
+// The HTTP layer calls into the backend from many threads at once.
+//
+//   accountsLock  - read-held by every operation that looks an account up,
+//                   write-held by create/delete (they change the index and slab).
+//   account stripes - one of ACCOUNT_STRIPES mutexes, chosen by accID, guards
+//                   the fields of every account that hashes to it. Operations on
+//                   different accounts almost never share a stripe.
+//   chainLock     - held by whoever is sealing blocks; the holder is the only
+//                   consumer of the pending ring and owns nextTxID. Readers walk
+//                   the chain without it: blocks never change once linked, and
+//                   'next' is published with a release store.
+//   historyLock   - the account history lists (see ACCOUNT HISTORY); write-held
+//                   by the chainLock holder as it links blocks.
+//   usersLock     - the user table and index.
+//   verifyLock    - the verified chain prefix; also lets one validation run at a time.
+//
+// The pending ring itself needs no lock. Lock order:
+// accountsLock -> stripes (ascending index) -> chainLock -> historyLock.
+//
+// In sequencer mode (start_sequencer()) every account mutation is a command
+// applied by the one sequencer thread instead, so writers never contend.
+// The sequencer is then the only writer of account fields: rather than
+// locking a stripe it bumps the stripe's version around each write, and
+// readers retry their copy if the version moved (a seqlock).
+#define ACCOUNT_STRIPE_BITS 8
+#define ACCOUNT_STRIPES (1 << ACCOUNT_STRIPE_BITS) // must match the initializer below
+
+typedef union account_stripe {
+    struct {
+        pbl_mutex lock;
+        volatile int64_t version; // sequencer mode only: odd while a write is in progress
+    } s;
+    char pad[PBL_CACHE_LINE]; // one stripe per cache line, so stripes don't false-share
+} account_stripe;
+
+#define STRIPE_INIT { { PBL_MUTEX_INIT, 0 } }
+#define STRIPES_4 STRIPE_INIT, STRIPE_INIT, STRIPE_INIT, STRIPE_INIT
+#define STRIPES_16 STRIPES_4, STRIPES_4, STRIPES_4, STRIPES_4
+#define STRIPES_64 STRIPES_16, STRIPES_16, STRIPES_16, STRIPES_16
+
+static account_stripe accountStripes[ACCOUNT_STRIPES] = { STRIPES_64, STRIPES_64, STRIPES_64, STRIPES_64 };
+static pbl_rwlock accountsLock = PBL_RWLOCK_INIT;
+static pbl_rwlock usersLock = PBL_RWLOCK_INIT;
+static pbl_mutex chainLock = PBL_MUTEX_INIT;
+static pbl_rwlock historyLock = PBL_RWLOCK_INIT;
+static pbl_mutex verifyLock = PBL_MUTEX_INIT;
+
+// ------------------------------------------- SEQUENCER --------------------------------------------------------
+// Callers publish a pointer to a command on their own stack into an MPSC
+// ring and wait for its 'done' flag; the sequencer applies commands in ring
+// order, seals once per batch, then completes the whole batch. Both sides
+// poll briefly, then yield, before parking on a condition variable. Polling
+// only pays off when the other side runs on another CPU, so single-CPU
+// machines go straight to yielding.
+#define SEQUENCER_RING_SIZE 65536
+#define SEQUENCER_BATCH 256
+#define WAIT_SPINS 200  // pbl_cpu_relax() polls (multi-CPU only)
+#define WAIT_YIELDS 50  // pbl_thread_yield() polls before parking
+
+enum {
+    CMD_CREATE,
+    CMD_DELETE,
+    CMD_UPDATE_NAME,
+    CMD_UPDATE_PHONE,
+    CMD_UPDATE_BALANCE,
+    CMD_DEPOSIT,
+    CMD_WITHDRAW,
+    CMD_TRANSFER,
+    CMD_BATCH
+};
+
+typedef struct ledger_command {
+    int type;
+    int id;
+    int toID;               // CMD_TRANSFER
+    float amount;           // deposit/withdraw/transfer/update balance
+    const char* text;       // new name or phone; owned by the waiting caller
+    const account* newacc;  // CMD_CREATE
+    batch_op* ops;          // CMD_BATCH, 'id' holds the count
+    int result;
+    volatile int64_t done;  // set by the sequencer once 'result' is final
+} ledger_command;
+
+static mpsc_ring commandRing;
+static pbl_thread sequencerThread;
+static volatile int64_t sequencerMode = 0;      // 1 while the sequencer owns all account writes
+static volatile int64_t sequencerStop = 0;
+static volatile int64_t sequencerParked = 0;    // 1 while waiting on sequencerWake
+static volatile int64_t completionWaiters = 0;  // callers parked on commandDone
+static int waitSpins = 0;                       // WAIT_SPINS, or 0 on one CPU
+static pbl_mutex wakeLock = PBL_MUTEX_INIT;
+static pbl_cond sequencerWake = PBL_COND_INIT;
+static pbl_mutex doneLock = PBL_MUTEX_INIT;
+static pbl_cond commandDone = PBL_COND_INIT;
 
 // ------------------------------------------- (INTERNAL) HELPER FUNCTIONS ----------------------------------------
 // These functions are "static" meaning they are private to this file
 // and not exposed in the header.
 
-static void saveuserstofile()
+static size_t memory_in_use()
 {
-    FILE *fp = fopen("users.dat", "wb");
-    if (fp == NULL)
+    return (size_t)(pbl_load64(&accountsBytes) + pbl_load64(&usersBytes) + pbl_load64(&pendingBytes));
+}
+
+// 1 if 'extra' more bytes still fit in the memory budget. Concurrent growers
+// can each pass the check, so the budget may be overshot by a chunk or two.
+static int within_budget(size_t extra)
+{
+    int64_t budget = pbl_load64(&memoryBudget);
+    return budget == 0 || memory_in_use() + extra <= (size_t)budget;
+}
+
+// Called with accountsLock write-held after anything that may have grown the account tables.
+static void publish_accounts_usage()
+{
+    pbl_store64(&accountsBytes, (int64_t)(seg_array_memory_usage(&accountSlab) + hash_index_memory_usage(&accountIndex) +
+                                          ordered_set_memory_usage(&accountOrder)));
+}
+
+// Called with usersLock write-held after anything that may have grown the user tables.
+static void publish_users_usage()
+{
+    pbl_store64(&usersBytes, (int64_t)(seg_array_memory_usage(&userTable) + hash_index_memory_usage(&userIndex)));
+}
+
+static uint32_t stripe_index(int id)
+{
+    uint32_t h = (uint32_t)id * 0x9E3779B1u; // Fibonacci hashing; the top bits are the best mixed
+    return h >> (32 - ACCOUNT_STRIPE_BITS);
+}
+
+static account_stripe *stripe_for(int id)
+{
+    return &accountStripes[stripe_index(id)];
+}
+
+// Excludes other writers of the stripe's accounts for a whole operation:
+// its checks, its enqueue and its writes (see CONCURRENCY). The sequencer is
+// the only writer in sequencer mode, so there it does nothing.
+static void stripe_lock(account_stripe *stripe)
+{
+    if (!pbl_load64(&sequencerMode)) pbl_mutex_lock(&stripe->s.lock);
+}
+
+static void stripe_unlock(account_stripe *stripe)
+{
+    if (!pbl_load64(&sequencerMode)) pbl_mutex_unlock(&stripe->s.lock);
+}
+
+// Brackets the stores to account fields, and the state record for them, with
+// the stripe locked: in sequencer mode the version is odd in between, so
+// readers retry only while fields are actually changing. A reader that sees
+// the new values can count on their record being in the log.
+static void stripe_write_begin(account_stripe *stripe)
+{
+    if (pbl_load64(&sequencerMode)) pbl_fetch_add64(&stripe->s.version, 1);
+}
+
+static void stripe_write_end(account_stripe *stripe)
+{
+    if (pbl_load64(&sequencerMode)) pbl_fetch_add64(&stripe->s.version, 1);
+}
+
+// Copies an account consistently while writers may be running. Caller holds accountsLock.
+static void read_account(const account *acc, account *out)
+{
+    account_stripe *stripe = stripe_for(acc->accID);
+    if (!pbl_load64(&sequencerMode))
     {
-        // In a real GUI app, you'd log this error.
+        pbl_mutex_lock(&stripe->s.lock);
+        *out = *acc;
+        pbl_mutex_unlock(&stripe->s.lock);
         return;
     }
-    fwrite(&usercount, sizeof(int), 1, fp);
-    fwrite(users, sizeof(user), usercount, fp);
-    fclose(fp);
+    for (;;)
+    {
+        int64_t version = pbl_load64(&stripe->s.version);
+        if (version & 1)
+        {
+            pbl_cpu_relax();
+            continue;
+        }
+        memcpy(out, acc, sizeof(account));
+        pbl_fence_acquire(); // the copy must finish before the version is re-read
+        if (pbl_load64(&stripe->s.version) == version) return;
+    }
+}
+
+static user *userat(int i)
+{
+    return (user *)seg_array_at(&userTable, (uint32_t)i);
+}
+
+// Appends a user to the table and indexes it.
+// Returns 0 on success, 1 if the memory budget is reached, 2 on allocation failure, 3 on duplicate ID.
+static int appenduser(const user *src)
+{
+    if (hash_index_find(&userIndex, src->id, NULL) == 0) return 3;
+
+    size_t cost = hash_index_insert_cost(&userIndex);
+    if ((uint64_t)usercount == seg_array_capacity(&userTable))
+        cost += seg_array_chunk_bytes(&userTable);
+    if (!within_budget(cost)) return 1;
+
+    if (seg_array_reserve(&userTable, (uint64_t)usercount + 1) != 0) return 2;
+    if (hash_index_insert(&userIndex, src->id, (uint32_t)usercount) != 0) return 2;
+    *userat(usercount) = *src;
+    usercount++;
+    publish_users_usage();
+    return 0;
+}
+
+#define USERS_FILE "users.dat"
+#define MAX_PATH_LEN 256
+
+// Writes every user to 'path' through 'path'.tmp, so a crash leaves the
+// previous file. Takes usersLock for reading if 'lock' is set.
+// Returns 0 on success, 1 if the file cannot be written.
+static int saveuserstofile(const char *path, int lock)
+{
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL)
+    {
+        return 1;
+    }
+    if (lock) pbl_rwlock_rdlock(&usersLock);
+    int ok = fwrite(&usercount, sizeof(int), 1, fp) == 1;
+    for (int i = 0; i < usercount && ok; i++)
+    {
+        ok = fwrite(userat(i), sizeof(user), 1, fp) == 1;
+    }
+    if (lock) pbl_rwlock_rdunlock(&usersLock);
+    ok = pbl_file_sync(fp) == 0 && ok;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || pbl_replace_file(tmp, path) != 0)
+    {
+        remove(tmp);
+        return 1;
+    }
+    return 0;
 }
 
 static void loadusersfromfile()
 {
-    FILE *fp = fopen("users.dat", "rb");
+    FILE *fp = fopen(USERS_FILE, "rb");
     if (fp == NULL)
     {
         return;
     }
-    fread(&usercount, sizeof(int), 1, fp);
-    fread(users, sizeof(user), usercount, fp);
+    int count = 0;
+    fread(&count, sizeof(int), 1, fp);
+    user u;
+    for (int i = 0; i < count; i++)
+    {
+        if (fread(&u, sizeof(user), 1, fp) != 1) break; // Short file
+        int result = appenduser(&u);
+        if (result == 1 || result == 2) break;           // Out of memory (duplicates are skipped)
+    }
     fclose(fp);
 }
 
-static void saveaccountstofile()
+static account_slot *slotat(uint32_t h)
 {
-    FILE *fp = fopen("accounts.dat", "wb");
-    if (fp == NULL)
+    return (account_slot *)seg_array_at(&accountSlab, h);
+}
+
+// Returns a free slab handle, adding a chunk if needed, or SLAB_NO_SLOT.
+static uint32_t slab_alloc()
+{
+    if (slabFreeHead != SLAB_NO_SLOT)
     {
-        return;
+        uint32_t h = slabFreeHead;
+        slabFreeHead = slotat(h)->nextFree;
+        return h;
+    }
+    if (slabUsed == SLAB_NO_SLOT) return SLAB_NO_SLOT;
+    if (seg_array_reserve(&accountSlab, (uint64_t)slabUsed + 1) != 0) return SLAB_NO_SLOT;
+    return slabUsed++;
+}
+
+static void slab_release(uint32_t h)
+{
+    account_slot *slot = slotat(h);
+    slot->live = 0;
+    slot->nextFree = slabFreeHead;
+    slabFreeHead = h;
+}
+
+// Copies 'src' into a free slab slot and indexes it.
+// Returns 0 on success, 1 if the memory budget is reached, 2 on allocation failure, 3 on duplicate ID.
+static int insertaccount(const account *src)
+{
+    if (hash_index_find(&accountIndex, src->accID, NULL) == 0) return 3;
+
+    size_t cost = hash_index_insert_cost(&accountIndex) + sizeof(ordered_set_leaf);
+    if (slabFreeHead == SLAB_NO_SLOT && slabUsed == seg_array_capacity(&accountSlab))
+        cost += seg_array_chunk_bytes(&accountSlab);
+    if (!within_budget(cost)) return 1;
+
+    uint32_t h = slab_alloc();
+    if (h == SLAB_NO_SLOT) return 2;
+    if (hash_index_insert(&accountIndex, src->accID, h) != 0)
+    {
+        slab_release(h);
+        return 2;
+    }
+    if (ordered_set_insert(&accountOrder, src->accID) != 0)
+    {
+        hash_index_remove(&accountIndex, src->accID);
+        slab_release(h);
+        return 2;
+    }
+    account_slot *slot = slotat(h);
+    slot->acc = *src;
+    slot->live = 1;
+    slot->historyFrom = 0;
+    accountcount++;
+    publish_accounts_usage();
+    return 0;
+}
+
+// Unindexes an account and frees its slot. Caller holds accountsLock for writing.
+// Returns 0 on success, 1 if there is no such account.
+static int removeaccount(int id)
+{
+    uint32_t h;
+    if (hash_index_find(&accountIndex, id, &h) != 0) return 1;
+    hash_index_remove(&accountIndex, id);
+    ordered_set_remove(&accountOrder, id);
+    slab_release(h);
+    accountcount--;
+    publish_accounts_usage();
+    return 0;
+}
+
+static account_slot *findslot(int id)
+{
+    uint32_t h;
+    if (hash_index_find(&accountIndex, id, &h) != 0)
+    {
+        return NULL;
     }
-    fwrite(&accountcount, sizeof(int), 1, fp);
-    for (int i = 0; i < accountcount; i++)
+    return slotat(h);
+}
+
+static account *findaccount(int id)
+{
+    account_slot *slot = findslot(id);
+    return slot == NULL ? NULL : &slot->acc;
+}
+
+// ---- ACCOUNTS FILE ----
+// accounts.dat is a header in its first ACCOUNTS_FILE_DATA bytes followed by
+// the slab's slots, ACCOUNT_SLOT_BYTES each, in native byte order:
+//   "PBLACCT\0" | version u32 | slot bytes u32 | 0x01020304 u32 | account bytes u32
+// Normally the file is mapped copy-on-write as the slab: startup only indexes
+// the live slots and replays the state log onto them, and updates change
+// private pages the OS never writes back. A checkpoint copies the slab a
+// chunk at a time, flushes the state log (so every change in the copy is in
+// a durable record) and only then writes the copy over the file's slots. The
+// file therefore never holds a change the log could not replay, such as one
+// side of a transfer still in flight at a crash; a crash part way through a
+// checkpoint leaves a mix of old and new slots, which the log (kept until
+// the checkpoint ends) brings up to date.
+//
+// The old format (an int count, then the accounts) is read into memory once
+// and rewritten in this one. If the file cannot be mapped the slab stays on
+// the heap and checkpoints write the same format through a temporary file.
+#define ACCOUNTS_FILE "accounts.dat"
+#define ACCOUNTS_FILE_UNKNOWN "accounts.dat.unknown"
+#define ACCOUNTS_FILE_VERSION 2
+#define ACCOUNTS_FILE_DATA MAPPED_FILE_ALIGN // offset of slot 0
+#define ACCOUNTS_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_CHUNK 4096
+
+typedef struct accounts_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotBytes;
+    uint32_t byteOrder;
+    uint32_t accountBytes;
+} accounts_file_header;
+
+static void accounts_header(accounts_file_header *h)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, "PBLACCT", 8);
+    h->version = ACCOUNTS_FILE_VERSION;
+    h->slotBytes = sizeof(account_slot);
+    h->byteOrder = ACCOUNTS_BYTE_ORDER;
+    h->accountBytes = sizeof(account);
+}
+
+// Returns 0 if there is no (or an empty) accounts.dat, 1 for the old format,
+// ACCOUNTS_FILE_VERSION for the current one, -1 for another version or layout.
+static int accounts_file_format()
+{
+    FILE *fp = fopen(ACCOUNTS_FILE, "rb");
+    if (fp == NULL)
     {
-        fwrite(accounts[i], sizeof(account), 1, fp);
+        return 0;
     }
+    accounts_file_header h, want;
+    size_t n = fread(&h, 1, sizeof(h), fp);
     fclose(fp);
+    if (n == 0) return 0;
+    if (n < sizeof(h.magic) || memcmp(h.magic, "PBLACCT", sizeof(h.magic)) != 0) return 1;
+    accounts_header(&want);
+    return n == sizeof(h) && memcmp(&h, &want, sizeof(h)) == 0 ? ACCOUNTS_FILE_VERSION : -1;
 }
 
-static void loadaccountsfromfile()
+// Empties the slab and its index, unmapping accounts.dat if it is mapped.
+// Caller holds accountsLock for writing.
+static void resetaccounts()
+{
+    seg_array_free(&accountSlab);
+    if (accountsMapped)
+    {
+        mapped_file_close(&accountsFile);
+        accountsMapped = 0;
+    }
+    slabUsed = 0;
+    slabFreeHead = SLAB_NO_SLOT;
+    accountcount = 0;
+    hash_index_free(&accountIndex);
+    ordered_set_free(&accountOrder);
+    publish_accounts_usage();
+}
+
+// Writes every account to 'path' through 'path'.tmp, so a crash leaves the
+// previous file. With 'lock' set, accountsLock is read-held for
+// SNAPSHOT_CHUNK slots at a time, so creates and deletes only pause briefly;
+// whatever changes meanwhile is in the state log, which replays on top.
+// (accounts.dat itself is only written this way for a heap slab.)
+// Returns 0 on success, 1 if the file cannot be written.
+static int saveaccountstofile(const char *path, int lock)
+{
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL)
+    {
+        return 1;
+    }
+    accounts_file_header header;
+    accounts_header(&header);
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fseek(fp, ACCOUNTS_FILE_DATA, SEEK_SET) == 0;
+    account_slot out;
+    memset(&out, 0, sizeof(out));
+    out.live = 1;
+    uint32_t h = 0;
+    int done = 0;
+    while (ok && !done)
+    {
+        if (lock) pbl_rwlock_rdlock(&accountsLock);
+        uint32_t end = slabUsed - h > SNAPSHOT_CHUNK ? h + SNAPSHOT_CHUNK : slabUsed;
+        for (; h < end && ok; h++)
+        {
+            account_slot *slot = slotat(h);
+            if (!slot->live) continue;
+            if (lock) read_account(&slot->acc, &out.acc);
+            else out.acc = slot->acc;
+            out.historyFrom = slot->historyFrom;
+            ok = fwrite(&out, sizeof(out), 1, fp) == 1;
+        }
+        done = h >= slabUsed;
+        if (lock) pbl_rwlock_rdunlock(&accountsLock);
+    }
+    ok = pbl_file_sync(fp) == 0 && ok;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || pbl_replace_file(tmp, path) != 0)
+    {
+        remove(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+// Makes accounts.dat hold every account as of the call. A mapped slab is
+// copied one chunk at a time with accountsLock read-held, so creates and
+// deletes only wait for a memory copy, and each copy is written to the file
+// once the state log records behind it are durable.
+// Returns 0 on success, 1 if the file cannot be written.
+static int syncaccountsfile()
+{
+    if (!accountsMapped) return saveaccountstofile(ACCOUNTS_FILE, 1);
+    account_slot *copy = (account_slot *)malloc(seg_array_chunk_bytes(&accountSlab));
+    if (copy == NULL) return 1;
+    int result = 0;
+    for (uint32_t first = 0; result == 0;)
+    {
+        pbl_rwlock_rdlock(&accountsLock);
+        uint32_t n = slabUsed - first > SEG_CHUNK_ELEMS ? SEG_CHUNK_ELEMS : slabUsed - first;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const account_slot *slot = slotat(first + i);
+            account_slot *out = &copy[i];
+            memset(out, 0, sizeof(*out));
+            out->live = slot->live;
+            out->nextFree = slot->nextFree;
+            out->historyFrom = slot->historyFrom;
+            if (slot->live == 1) read_account(&slot->acc, &out->acc);
+        }
+        pbl_rwlock_rdunlock(&accountsLock);
+        if (n == 0) break;
+        if (pbl_load64(&stateOpen) && record_log_flush(&stateLog) != 0) result = 1;
+        else if (mapped_file_write(&accountsFile, ACCOUNTS_FILE_DATA + (uint64_t)first * sizeof(account_slot),
+                                   copy, (size_t)n * sizeof(account_slot)) != 0)
+            result = 1;
+        first += n;
+    }
+    free(copy);
+    if (mapped_file_flush(&accountsFile) != 0) result = 1;
+    return result;
+}
+
+// Reads accounts.dat (old or current format) into a heap slab.
+// Caller holds accountsLock for writing.
+static void readaccountsfile(int format)
 {
-    FILE *fp = fopen("accounts.dat", "rb");
+    FILE *fp = fopen(ACCOUNTS_FILE, "rb");
     if (fp == NULL)
     {
         return;
     }
-    fread(&accountcount, sizeof(int), 1, fp);
-    for (int i = 0; i < accountcount; i++)
+    if (format == 1)
+    {
+        int count = 0;
+        fread(&count, sizeof(int), 1, fp);
+        account acc;
+        for (int i = 0; i < count; i++)
+        {
+            if (fread(&acc, sizeof(account), 1, fp) != 1) break; // Short file
+            if (insertaccount(&acc) == 1) break;                  // Memory budget reached
+        }
+    }
+    else if (fseek(fp, ACCOUNTS_FILE_DATA, SEEK_SET) == 0)
     {
-        account *acc = (account *)malloc(sizeof(account));
-        if (acc) {
-            fread(acc, sizeof(account), 1, fp);
-            accounts[i] = acc;
+        account_slot slot;
+        while (fread(&slot, sizeof(slot), 1, fp) == 1)
+        {
+            if (slot.live != 1) continue;
+            int inserted = insertaccount(&slot.acc);
+            if (inserted == 1) break; // Memory budget reached
+            if (inserted == 0) findslot(slot.acc.accID)->historyFrom = slot.historyFrom;
         }
     }
     fclose(fp);
 }
 
-static account *findaccount(int id)
+// Maps accounts.dat (creating it if needed) as the slab and indexes its live
+// slots; dead ones below the last live slot make up the free list. Caller
+// holds accountsLock for writing and the slab is empty.
+// Returns 0 on success, 2 if the file cannot be mapped or memory runs out.
+static int mapaccountsfile()
 {
-    for (int i = 0; i < accountcount; i++)
+    if (mapped_file_open(&accountsFile, ACCOUNTS_FILE) != 0) return 2;
+    accounts_file_header header;
+    accounts_header(&header);
+    int ok = mapped_file_grow(&accountsFile, ACCOUNTS_FILE_DATA) == 0 &&
+             mapped_file_write(&accountsFile, 0, &header, sizeof(header)) == 0;
+
+    uint64_t slots = (accountsFile.size - ACCOUNTS_FILE_DATA) / sizeof(account_slot);
+    if (slots > SLAB_NO_SLOT) slots = SLAB_NO_SLOT;
+    if (!ok || seg_array_map(&accountSlab, &accountsFile, ACCOUNTS_FILE_DATA, slots) != 0)
     {
-        if (accounts[i]->accID == id)
+        mapped_file_close(&accountsFile);
+        return 2;
+    }
+    accountsMapped = 1;
+
+    for (uint32_t h = 0; h < (uint32_t)slots; h++)
+    {
+        account_slot *slot = slotat(h);
+        if (slot->live != 1) continue;
+        int inserted = hash_index_insert(&accountIndex, slot->acc.accID, h);
+        if (inserted == 1)
+        {
+            slot->live = 0; // a stale copy; the state log has the current one
+            continue;
+        }
+        if (inserted != 0 || ordered_set_insert(&accountOrder, slot->acc.accID) != 0)
         {
-            return accounts[i];
+            resetaccounts();
+            return 2;
         }
+        accountcount++;
+        slabUsed = h + 1;
     }
-    return NULL;
+    for (uint32_t h = slabUsed; h-- > 0;)
+    {
+        if (slotat(h)->live != 1) slab_release(h);
+    }
+    publish_accounts_usage();
+    return 0;
+}
+
+// Loads accounts.dat as the slab: mapped if possible, else read into memory.
+// A file in the old format is converted first. Takes accountsLock.
+static void loadaccountsfromfile()
+{
+    int format = accounts_file_format();
+    if (format < 0)
+    {
+        fprintf(stderr, "accounts.dat has an unknown layout, moving it to %s and starting without accounts\n",
+                ACCOUNTS_FILE_UNKNOWN);
+        pbl_replace_file(ACCOUNTS_FILE, ACCOUNTS_FILE_UNKNOWN);
+    }
+    pbl_rwlock_wrlock(&accountsLock);
+    if (format == 1)
+    {
+        readaccountsfile(1);
+        pbl_rwlock_wrunlock(&accountsLock);
+        int converted = saveaccountstofile(ACCOUNTS_FILE, 1) == 0;
+        pbl_rwlock_wrlock(&accountsLock);
+        if (!converted)
+        {
+            // Carry on from memory; the next checkpoint tries again.
+            pbl_rwlock_wrunlock(&accountsLock);
+            return;
+        }
+        resetaccounts();
+    }
+    if (mapaccountsfile() != 0) readaccountsfile(ACCOUNTS_FILE_VERSION);
+    pbl_rwlock_wrunlock(&accountsLock);
 }
 
-static unsigned long djb2_hash(const char* str) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + (unsigned char)c;
-    return hash;
+// ---- BLOCK HASHING ----
+// A block's hash is SHA-256 over its header; the header commits to the
+// transactions through a Merkle root (see MERKLE TREES). Encodings are
+// canonical, integers little-endian:
+//   header:      index u32 | timestamp i64 | transactionCount u32 |
+//                previousHash (32 bytes) | merkleRoot (32 bytes)
+//   transaction: txID u32 | fromAcc u32 | toAcc u32 | amount (IEEE-754 bits) u32 |
+//                timestamp i64 | remark length u8 | remark bytes
+#define BLOCK_HEADER_BYTES (4 + 8 + 4 + 2 * SHA256_DIGEST_LEN)
+#define TX_RECORD_MAX (4 * 4 + 8 + 1 + sizeof(((Transaction*)0)->remark))
+
+// tx_proof (backend.h) carries these encodings verbatim.
+typedef char proof_header_size_check[BLOCK_HEADER_BYTES == PROOF_HEADER_LEN ? 1 : -1];
+typedef char proof_leaf_size_check[1 + TX_RECORD_MAX <= PROOF_LEAF_MAX ? 1 : -1];
+
+static unsigned char* put_le32(unsigned char* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 4;
 }
 
-static void compute_hash_for_block(Block* blk, char out[HASH_STR_LEN]) {
-    char buf[4096];
-    buf[0] = 0;
-    sprintf(buf + strlen(buf), "%d|%s|%s|", blk->index, blk->timestamp, blk->previousHash);
-    for (int i = 0; i < blk->transactionCount; i++) {
-        Transaction *t = &blk->transactions[i];
-        sprintf(buf + strlen(buf), "%d:%d->%d:%.2f:%s|", t->txID, t->fromAcc, t->toAcc, t->amount, t->timestamp);
+static unsigned char* put_le64(unsigned char* p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 8;
+}
+
+static uint32_t get_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const unsigned char* p)
+{
+    return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static size_t encode_block_header(const Block* blk, unsigned char out[BLOCK_HEADER_BYTES])
+{
+    unsigned char* p = put_le32(out, (uint32_t)blk->index);
+    p = put_le64(p, (uint64_t)blk->timestamp);
+    p = put_le32(p, (uint32_t)blk->transactionCount);
+    memcpy(p, blk->previousHash.w, SHA256_DIGEST_LEN);
+    memcpy(p + SHA256_DIGEST_LEN, blk->merkleRoot.w, SHA256_DIGEST_LEN);
+    return BLOCK_HEADER_BYTES;
+}
+
+static size_t encode_transaction(const Transaction* t, unsigned char out[TX_RECORD_MAX])
+{
+    uint32_t amountBits;
+    memcpy(&amountBits, &t->amount, sizeof(amountBits));
+    size_t remarkLen = strlen(t->remark);
+    unsigned char* p = put_le32(out, (uint32_t)t->txID);
+    p = put_le32(p, (uint32_t)t->fromAcc);
+    p = put_le32(p, (uint32_t)t->toAcc);
+    p = put_le32(p, amountBits);
+    p = put_le64(p, (uint64_t)t->timestamp);
+    *p++ = (unsigned char)remarkLen;
+    memcpy(p, t->remark, remarkLen);
+    return (size_t)(p - out) + remarkLen;
+}
+
+static int hash_equal(const block_hash* a, const block_hash* b)
+{
+    return ((a->w[0] ^ b->w[0]) | (a->w[1] ^ b->w[1]) | (a->w[2] ^ b->w[2]) | (a->w[3] ^ b->w[3])) == 0;
+}
+
+static void hash_to_hex(const block_hash* h, char out[HASH_STR_LEN])
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    const unsigned char* digest = (const unsigned char*)h->w;
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        out[2 * i] = hexdigits[digest[i] >> 4];
+        out[2 * i + 1] = hexdigits[digest[i] & 15];
+    }
+    out[2 * SHA256_DIGEST_LEN] = '\0';
+}
+
+// The block hash; merkleRoot must already be filled in.
+static void compute_hash_for_block(const Block* blk, block_hash* out) {
+    unsigned char header[BLOCK_HEADER_BYTES];
+    sha256(header, encode_block_header(blk, header), (unsigned char*)out->w);
+}
+
+// ---- MERKLE TREES ----
+// Leaves are SHA-256(0x00 || transaction encoding) and inner nodes
+// SHA-256(0x01 || left || right); the prefixes keep a leaf from passing for
+// a node. Each level pairs nodes left to right, and an odd node at the end
+// moves up a level unchanged. A block without transactions has an all-zero
+// root.
+#define MERKLE_MAX_DEPTH 32 // enough for any int transaction count
+
+// Hashes leaves [from, from + n) of a block (1 <= n <= SHA256_LANES) side by side.
+static void hash_leaves(const Block* blk, int from, int n, block_hash* out)
+{
+    unsigned char leaf[SHA256_LANES][1 + TX_RECORD_MAX];
+    const unsigned char* data[SHA256_LANES];
+    size_t len[SHA256_LANES];
+    for (int i = 0; i < n; i++) {
+        leaf[i][0] = 0x00;
+        len[i] = 1 + encode_transaction(&blk->transactions[from + i], leaf[i] + 1);
+        data[i] = leaf[i];
+    }
+    sha256_many(data, len, n, (unsigned char (*)[SHA256_DIGEST_LEN])out);
+}
+
+// out = the parent of 'left' and 'right' (out may alias either).
+static void merkle_node(const block_hash* left, const block_hash* right, block_hash* out)
+{
+    unsigned char buf[1 + 2 * SHA256_DIGEST_LEN];
+    buf[0] = 0x01;
+    memcpy(buf + 1, left->w, SHA256_DIGEST_LEN);
+    memcpy(buf + 1 + SHA256_DIGEST_LEN, right->w, SHA256_DIGEST_LEN);
+    sha256(buf, sizeof(buf), (unsigned char*)out->w);
+}
+
+// Builds the root in one pass with a stack of finished subtrees, merging
+// two as soon as they are the same height. Folding what is left from the
+// right gives the same tree as pairing level by level.
+static void compute_merkle_root(const Block* blk, block_hash* out)
+{
+    block_hash stack[MERKLE_MAX_DEPTH + 1];
+    int height[MERKLE_MAX_DEPTH + 1];
+    int top = 0;
+    if (blk->transactionCount == 0) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    for (int from = 0; from < blk->transactionCount; from += SHA256_LANES) {
+        block_hash leaves[SHA256_LANES];
+        int n = blk->transactionCount - from < SHA256_LANES ? blk->transactionCount - from : SHA256_LANES;
+        hash_leaves(blk, from, n, leaves);
+        for (int i = 0; i < n; i++) {
+            block_hash node = leaves[i];
+            int h = 0;
+            while (top > 0 && height[top - 1] == h) {
+                merkle_node(&stack[--top], &node, &node);
+                h++;
+            }
+            stack[top] = node;
+            height[top++] = h;
+        }
+    }
+    block_hash root = stack[top - 1];
+    for (int i = top - 2; i >= 0; i--)
+        merkle_node(&stack[i], &root, &root);
+    *out = root;
+}
+
+// Allocates a block with room for 'capacity' transactions (none filled in yet).
+static Block* allocBlock(int capacity) {
+    Block* blk = (Block*)malloc(sizeof(Block) + sizeof(Transaction) * (size_t)capacity);
+    if (!blk) return NULL;
+    blk->transactions = (Transaction*)(blk + 1);
+    blk->transactionCount = 0;
+    blk->next = NULL;
+    return blk;
+}
+
+// ---- ACCOUNT HISTORY ----
+// Every account's sealed transactions as an append-only list of txIDs. Lists
+// are appended in chain order, so they are sorted, and a statement page
+// costs O(log n + page) rather than a chain scan. 0 stands for the bank in
+// deposits and withdrawals and gets no list.
+//
+// Lists are keyed by account ID, and IDs can be reused, so a statement only
+// covers txIDs from its account slot's historyFrom on: the first txID handed
+// out after the account was created, kept in accounts.dat and the state log
+// because the ledger (which rebuilds the lists on startup) does not record
+// creates. Deleting an account empties its list; statements are only served
+// for accounts that exist, and a closed account's transactions stay in the
+// ledger (GET /api/tx/{id}).
+typedef struct posting_list {
+    int* txIDs;
+    uint32_t count;
+    uint32_t capacity;
+} posting_list;
+
+static hash_index historyIndex; // accID -> slot in historyLists
+static seg_array historyLists = { NULL, sizeof(posting_list), 0, NULL, 0 };
+static uint32_t historyCount = 0; // lists in use
+static int historyFailed = 0;     // sticky: a posting was lost to out of memory
+
+// Index of the first txID >= 'txID' in a list.
+static uint32_t first_posting(const posting_list* list, long long txID)
+{
+    uint32_t lo = 0, hi = list->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((long long)list->txIDs[mid] < txID) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Appends txID to accID's list. Caller write-holds historyLock.
+static int post_transaction(int accID, int txID)
+{
+    uint32_t slot;
+    if (hash_index_find(&historyIndex, accID, &slot) != 0) {
+        slot = historyCount;
+        if (seg_array_reserve(&historyLists, (uint64_t)slot + 1) != 0 ||
+            hash_index_insert(&historyIndex, accID, slot) != 0)
+            return 2;
+        historyCount++;
+    }
+    posting_list* list = (posting_list*)seg_array_at(&historyLists, slot);
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 4;
+        int* bigger = (int*)realloc(list->txIDs, sizeof(int) * (size_t)capacity);
+        if (bigger == NULL) return 2;
+        list->txIDs = bigger;
+        list->capacity = capacity;
+    }
+    list->txIDs[list->count++] = txID;
+    return 0;
+}
+
+// Posts a block's transactions to the histories of both accounts involved.
+// Caller holds chainLock (or is replaying the ledger).
+static void post_block(const Block* blk)
+{
+    if (blk->transactionCount == 0) return;
+    pbl_rwlock_wrlock(&historyLock);
+    for (int i = 0; i < blk->transactionCount && !historyFailed; i++) {
+        const Transaction* t = &blk->transactions[i];
+        if ((t->fromAcc != 0 && post_transaction(t->fromAcc, t->txID) != 0) ||
+            (t->toAcc != 0 && t->toAcc != t->fromAcc && post_transaction(t->toAcc, t->txID) != 0)) {
+            historyFailed = 1;
+            fprintf(stderr, "account history: out of memory, statements are unavailable until restart\n");
+        }
+    }
+    pbl_rwlock_wrunlock(&historyLock);
+}
+
+// Empties accID's list. Takes historyLock.
+static void forget_history(int accID)
+{
+    uint32_t slot;
+    pbl_rwlock_wrlock(&historyLock);
+    if (hash_index_find(&historyIndex, accID, &slot) == 0) {
+        posting_list* list = (posting_list*)seg_array_at(&historyLists, slot);
+        free(list->txIDs);
+        list->txIDs = NULL;
+        list->count = 0;
+        list->capacity = 0;
+    }
+    pbl_rwlock_wrunlock(&historyLock);
+}
+
+static void reset_history()
+{
+    pbl_rwlock_wrlock(&historyLock);
+    for (uint32_t i = 0; i < historyCount; i++)
+        free(((posting_list*)seg_array_at(&historyLists, i))->txIDs);
+    seg_array_free(&historyLists);
+    hash_index_free(&historyIndex);
+    historyCount = 0;
+    historyFailed = 0;
+    pbl_rwlock_wrunlock(&historyLock);
+}
+
+// ---- BLOCK INDEXES ----
+// blockIndex[h] is the block at height h, so seeking costs O(1) rather than
+// a walk from genesis. Its chunks never move, so readers use it without
+// chainLock: a slot is written before indexedBlocks is raised past it, and
+// readers only look below indexedBlocks.
+static seg_array blockIndex = { NULL, sizeof(Block*), 0, NULL, 0 };
+static volatile int64_t indexedBlocks = 0;
+
+// txIndex[id - 1] is where transaction 'id' was sealed. txIDs are handed out
+// consecutively in chain order, so a dense array covers them at 8 bytes
+// each. Published through indexedTxs the same way.
+typedef struct tx_ref {
+    uint32_t block; // height
+    uint32_t slot;  // position in the block's transactions[]
+} tx_ref;
+static seg_array txIndex = { NULL, sizeof(tx_ref), 0, NULL, 0 };
+static volatile int64_t indexedTxs = 0;
+
+// Records a block just linked at the tail, and posts it to the account
+// histories. Caller holds chainLock (or is replaying the ledger). If memory
+// runs out (or a ledger has gaps in its txIDs) an index stops growing, and
+// lookups past its end walk the chain from its last entry.
+static void index_block(Block* blk)
+{
+    post_block(blk);
+
+    int64_t n = pbl_load64(&indexedBlocks);
+    if (n == blk->index && seg_array_reserve(&blockIndex, (uint64_t)n + 1) == 0) {
+        *(Block**)seg_array_at(&blockIndex, (uint32_t)n) = blk;
+        pbl_store64(&indexedBlocks, n + 1);
+    }
+
+    int count = blk->transactionCount;
+    int64_t t = pbl_load64(&indexedTxs);
+    if (count == 0 || blk->transactions[0].txID != t + 1 || blk->transactions[count - 1].txID != t + count)
+        return;
+    if (seg_array_reserve(&txIndex, (uint64_t)(t + count)) != 0) return;
+    for (int i = 0; i < count; i++) {
+        tx_ref* ref = (tx_ref*)seg_array_at(&txIndex, (uint32_t)(t + i));
+        ref->block = (uint32_t)blk->index;
+        ref->slot = (uint32_t)i;
+    }
+    pbl_store64(&indexedTxs, t + count);
+}
+
+// ---- LEDGER LOG ----
+// One record per block, in chain order: the header encoding, the block hash,
+// then each transaction's encoding (see BLOCK HASHING). Blocks are appended
+// under chainLock as they are linked; a caller waits for its transaction's
+// block (await_sealed()) and then calls flush_ledger() before reporting
+// success, so one write + fdatasync covers every block sealed meanwhile
+// (group commit, see record_log.h).
+#define LEDGER_TX_MIN (4 * 4 + 8 + 1) // a transaction encoding with an empty remark
+
+// Appends a block's record to 'log'. Returns 0 on success, 2 if the log has failed.
+static int append_block(record_log* log, const Block* blk)
+{
+    uint64_t maxLen = BLOCK_HEADER_BYTES + SHA256_DIGEST_LEN + TX_RECORD_MAX * (uint64_t)blk->transactionCount;
+    unsigned char* rec = record_log_begin(log, maxLen > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)maxLen);
+    if (rec == NULL) return 2;
+    size_t len = encode_block_header(blk, rec);
+    memcpy(rec + len, blk->currHash.w, SHA256_DIGEST_LEN);
+    len += SHA256_DIGEST_LEN;
+    for (int i = 0; i < blk->transactionCount; i++)
+        len += encode_transaction(&blk->transactions[i], rec + len);
+    record_log_end(log, (uint32_t)len);
+    return 0;
+}
+
+// Appends a linked block to the ledger log. Caller holds chainLock.
+static void log_block(const Block* blk)
+{
+    if (pbl_load64(&ledgerOpen)) append_block(&ledgerLog, blk); // a failed log has said so
+}
+
+// Returns once every block linked so far is in the ledger log.
+static void flush_ledger()
+{
+    if (pbl_load64(&ledgerOpen)) record_log_flush(&ledgerLog);
+}
+
+// record_log_visit for the ledger: decodes one block and links it at the
+// tail. Returns 1 for a record that does not decode or does not follow the
+// chain so far; its hashes are only checked by chain validation, like any other block.
+static int replay_block(const unsigned char* rec, uint32_t len, void* arg)
+{
+    (void)arg;
+    if (len < BLOCK_HEADER_BYTES + SHA256_DIGEST_LEN) return 1;
+    uint32_t index = get_le32(rec);
+    uint32_t count = get_le32(rec + 12);
+    if (index != (uint32_t)blockCount) return 1;
+    if (count > (len - BLOCK_HEADER_BYTES - SHA256_DIGEST_LEN) / LEDGER_TX_MIN) return 1;
+
+    Block* blk = allocBlock((int)count);
+    if (blk == NULL) return 2;
+    blk->index = (int)index;
+    blk->timestamp = (int64_t)get_le64(rec + 4);
+    memcpy(blk->previousHash.w, rec + 16, SHA256_DIGEST_LEN);
+    memcpy(blk->merkleRoot.w, rec + 16 + SHA256_DIGEST_LEN, SHA256_DIGEST_LEN);
+    memcpy(blk->currHash.w, rec + BLOCK_HEADER_BYTES, SHA256_DIGEST_LEN);
+
+    const unsigned char* p = rec + BLOCK_HEADER_BYTES + SHA256_DIGEST_LEN;
+    const unsigned char* end = rec + len;
+    for (uint32_t i = 0; i < count; i++) {
+        Transaction* t = &blk->transactions[i];
+        uint32_t amountBits;
+        if (end - p < LEDGER_TX_MIN || p[LEDGER_TX_MIN - 1] >= sizeof(t->remark) ||
+            end - p < LEDGER_TX_MIN + p[LEDGER_TX_MIN - 1]) {
+            free(blk);
+            return 1;
+        }
+        t->txID = (int)get_le32(p);
+        t->fromAcc = (int)get_le32(p + 4);
+        t->toAcc = (int)get_le32(p + 8);
+        amountBits = get_le32(p + 12);
+        memcpy(&t->amount, &amountBits, sizeof(t->amount));
+        t->timestamp = (int64_t)get_le64(p + 16);
+        size_t remarkLen = p[LEDGER_TX_MIN - 1];
+        memcpy(t->remark, p + LEDGER_TX_MIN, remarkLen);
+        t->remark[remarkLen] = '\0';
+        p += LEDGER_TX_MIN + remarkLen;
     }
-    unsigned long h = djb2_hash(buf);
-    sprintf(out, "%lx", h);
+    block_hash zero;
+    memset(&zero, 0, sizeof(zero));
+    if (p != end || !hash_equal(&blk->previousHash, blockchainTail ? &blockchainTail->currHash : &zero)) {
+        free(blk);
+        return 1;
+    }
+    blk->transactionCount = (int)count;
+
+    if (blockchainTail) blockchainTail->next = blk;
+    else blockchainHead = blk;
+    blockchainTail = blk;
+    blockCount++;
+    index_block(blk);
+    if (count > 0 && blk->transactions[count - 1].txID >= nextTxID)
+        nextTxID = blk->transactions[count - 1].txID + 1;
+    return 0;
 }
 
 static void createGenesisBlock() {
     // Only create if one doesn't exist (e.g., on first-ever run)
     if (blockchainHead != NULL) return;
 
-    Block* genesis = (Block*)malloc(sizeof(Block));
+    Block* genesis = allocBlock(0);
     if (!genesis) return;
     genesis->index = 0;
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(genesis->timestamp, sizeof(genesis->timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-    genesis->transactionCount = 0;
-    strcpy(genesis->previousHash, "0");
-    compute_hash_for_block(genesis, genesis->currHash);
-    genesis->next = NULL;
+    genesis->timestamp = timestamp_now_us();
+    memset(&genesis->previousHash, 0, sizeof(block_hash));
+    compute_merkle_root(genesis, &genesis->merkleRoot);
+    compute_hash_for_block(genesis, &genesis->currHash);
     blockchainHead = blockchainTail = genesis;
     blockCount = 1;
+    index_block(genesis);
+    log_block(genesis);
 }
 
-static void addBlockFromPending() {
-    if (pendingCount == 0) return;
-
-    Block* blk = (Block*)malloc(sizeof(Block));
-    if (!blk) return;
-
+// Stamps, hashes and appends a filled-in block at the tail. Caller holds chainLock.
+static void linkBlock(Block* blk) {
     blk->index = blockCount;
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(blk->timestamp, sizeof(blk->timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
-
-    int take = (pendingCount < BLOCK_CAP) ? pendingCount : BLOCK_CAP;
-    blk->transactionCount = take;
-    for (int i = 0; i < take; i++) {
-        blk->transactions[i] = pendingPool[i];
-    }
-    for (int i = take; i < pendingCount; i++) {
-        pendingPool[i - take] = pendingPool[i];
-    }
-    pendingCount -= take;
+    blk->timestamp = timestamp_now_us();
 
     if (blockchainTail != NULL) {
-        strcpy(blk->previousHash, blockchainTail->currHash);
+        blk->previousHash = blockchainTail->currHash;
     } else {
-        strcpy(blk->previousHash, "0");
+        memset(&blk->previousHash, 0, sizeof(block_hash));
     }
 
-    compute_hash_for_block(blk, blk->currHash);
+    compute_merkle_root(blk, &blk->merkleRoot);
+    compute_hash_for_block(blk, &blk->currHash);
 
     blk->next = NULL;
     if (blockchainTail) {
-        blockchainTail->next = blk;
+        // Release store: a reader that sees the pointer also sees the block contents.
+        pbl_store_ptr((void* volatile*)&blockchainTail->next, blk);
         blockchainTail = blk;
     } else {
         blockchainHead = blockchainTail = blk;
     }
     blockCount++;
+    index_block(blk);
+    log_block(blk);
 }
 
-static void recordTransaction(int fromAcc, int toAcc, float amount, const char* remark) {
-    if (pendingCount >= MAX_PENDING) {
-        return;
+// Transactions per block under the current policy: blockMaxTx, further
+// limited by the byte cap. With 'batch' set only the byte cap applies
+// (0 = unlimited), so a batch lands in as few blocks as possible. A normal
+// block is never larger than the pending ring.
+static int block_capacity(int batch)
+{
+    int64_t maxBytes = pbl_load64(&blockMaxBytes);
+    int64_t cap = batch ? 0 : pbl_load64(&blockMaxTx);
+    if (maxBytes > 0)
+    {
+        int64_t byBytes = maxBytes / (int64_t)sizeof(Transaction);
+        if (cap == 0 || byBytes < cap) cap = byBytes;
     }
-    Transaction t;
-    t.txID = nextTxID++;
-    t.fromAcc = fromAcc;
-    t.toAcc = toAcc;
-    t.amount = amount;
-    strncpy(t.remark, remark, sizeof(t.remark)-1);
-    t.remark[sizeof(t.remark)-1] = 0;
+    if (batch) return cap > 0x7FFFFFFF ? 0x7FFFFFFF : (int)cap;
+    return cap < 1 ? 1 : (cap > PENDING_RING_SIZE ? PENDING_RING_SIZE : (int)cap);
+}
+
+// 1 if the oldest pending transaction has waited out blockMaxDelayMs.
+static int pending_expired()
+{
+    int64_t delay = pbl_load64(&blockMaxDelayMs);
+    int64_t since = pbl_load64(&pendingSince);
+    return delay > 0 && since != 0 && pbl_now_ms() - since >= delay;
+}
+
+// Allocates the pending ring on first use; initialize_system() is optional
+// for callers such as the benchmarks. Returns 0 once the ring is ready.
+static int ensure_pending_ring()
+{
+    int64_t state = pbl_load64(&pendingRingState);
+    if (state == 2) return 0;
+    if (state == 0 && pbl_cas64(&pendingRingState, 0, 1))
+    {
+        int ok = mpsc_ring_init(&pendingRing, sizeof(Transaction), PENDING_RING_SIZE) == 0;
+        if (ok) pbl_store64(&pendingBytes, (int64_t)mpsc_ring_memory_usage(&pendingRing));
+        pbl_store64(&pendingRingState, ok ? 2 : 3);
+        return ok ? 0 : 2;
+    }
+    while ((state = pbl_load64(&pendingRingState)) == 1)
+        pbl_thread_yield();
+    return state == 2 ? 0 : 2;
+}
 
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(t.timestamp, sizeof(t.timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+// ---- SEALING ----
+// Whoever holds chainLock pops transactions off the pending ring straight
+// into a new block, stamps their txIDs and links the block. Producers keep
+// pushing meanwhile; the sealer never shifts or copies the pool.
 
-    pendingPool[pendingCount++] = t;
+// Pops exactly 'count' transactions. They have all been claimed by
+// producers, who publish each one right after copying it in, so a short
+// read only means one is mid-copy.
+static void pop_pending(Transaction *out, int count)
+{
+    int got = 0;
+    for (;;)
+    {
+        got += mpsc_ring_pop(&pendingRing, out + got, count - got);
+        if (got == count) return;
+        pbl_thread_yield();
+    }
+}
+
+// Seals full blocks while there are enough pending transactions, or up to
+// 'limit' transactions in total regardless of block fill if 'all' is set.
+// Caller holds chainLock. Returns 1 if a block could not be allocated (the
+// transactions stay in the ring for the next attempt).
+static int sealFromRing(int all, int64_t limit)
+{
+    int cap = block_capacity(0);
+    int64_t sealed = 0;
+    for (;;)
+    {
+        int64_t pending = mpsc_ring_size(&pendingRing);
+        if (all && pending > limit - sealed) pending = limit - sealed;
+        int n = pending >= cap ? cap : (all ? (int)pending : 0);
+        if (n == 0) break;
+
+        Block *blk = allocBlock(n);
+        if (blk == NULL) return 1;
+        pop_pending(blk->transactions, n);
+        for (int i = 0; i < n; i++)
+            blk->transactions[i].txID = nextTxID++;
+        blk->transactionCount = n;
+        linkBlock(blk);
+        pbl_store64(&sealedThrough, pbl_load64(&sealedThrough) + n);
+        sealed += n;
+    }
+    if (sealed > 0 && pbl_load64(&sealWaiters) > 0)
+    {
+        pbl_mutex_lock(&sealedLock);
+        pbl_cond_broadcast(&sealedCond);
+        pbl_mutex_unlock(&sealedLock);
+    }
+    if (all)
+    {
+        // Restart the delay clock. A producer that pushed concurrently either
+        // shows up in the size check or sees pendingSince == 0 and sets it.
+        pbl_store64(&pendingSince, 0);
+        if (mpsc_ring_size(&pendingRing) > 0)
+            pbl_cas64(&pendingSince, 0, pbl_now_ms());
+    }
+    return 0;
+}
+
+// Seals every full block's worth of pending transactions (or everything
+// pending, if 'force' or the oldest one has waited blockMaxDelayMs). Only
+// one thread seals at a time; anyone who finds chainLock taken leaves their
+// transactions to the current sealer, which re-checks the ring after it unlocks.
+static void sealPendingBlocks(int force) {
+    if (pbl_load64(&pendingRingState) != 2) return;
+    int cap = block_capacity(0);
+    for (;;) {
+        int64_t pending = mpsc_ring_size(&pendingRing);
+        int all = force || pending_expired();
+        if (pending == 0 || (pending < cap && !all)) return;
+
+        if (pbl_mutex_trylock(&chainLock) != 0) return;
+        int failed = sealFromRing(all, pending);
+        pbl_mutex_unlock(&chainLock);
+        if (force || failed) return;
+    }
+}
+
+// The txID the next transaction enqueued will get (the ring is sealed in
+// order, and batches seal it before themselves). Caller holds chainLock and
+// write-holds accountsLock, so no producer is mid-push.
+static int next_tx_id()
+{
+    int64_t pending = pbl_load64(&pendingRingState) == 2 ? mpsc_ring_size(&pendingRing) : 0;
+    return nextTxID + (int)pending;
+}
+
+// Returns once the transaction with ring ticket 'ticket' is in a linked
+// block, so a deposit, withdrawal or transfer never reports success (and
+// flushes) ahead of its block. Without a seal delay the caller seals
+// whatever is pending itself, waiting for chainLock if another sealer has
+// it; with one, a transaction waiting for its block to fill is left to the
+// policy, which seals it within the delay.
+// Returns 0 once sealed, 4 if a block could not be allocated (the
+// transaction then stays pending).
+static int await_sealed(int64_t ticket)
+{
+    while (pbl_load64(&sealedThrough) <= ticket)
+    {
+        sealPendingBlocks(0);
+        if (pbl_load64(&sealedThrough) > ticket) break;
+        int64_t delay = pbl_load64(&blockMaxDelayMs);
+        if (delay == 0)
+        {
+            int failed = 0;
+            pbl_mutex_lock(&chainLock);
+            if (pbl_load64(&sealedThrough) <= ticket)
+                failed = sealFromRing(1, mpsc_ring_size(&pendingRing));
+            pbl_mutex_unlock(&chainLock);
+            if (failed) return 4;
+            continue;
+        }
+        pbl_fetch_add64(&sealWaiters, 1);
+        pbl_mutex_lock(&sealedLock);
+        if (pbl_load64(&sealedThrough) <= ticket)
+            pbl_cond_timedwait_ms(&sealedCond, &sealedLock, (long)delay);
+        pbl_mutex_unlock(&sealedLock);
+        pbl_fetch_add64(&sealWaiters, -1);
+    }
+    return 0;
+}
+
+// Background thread that seals a partly filled block once its oldest
+// transaction has waited blockMaxDelayMs. Only runs while a delay is set.
+static pbl_thread sealTimerThread;
+static int sealTimerRunning = 0;
+static volatile int64_t sealTimerStop = 0;
+static pbl_mutex sealTimerLock = PBL_MUTEX_INIT;
+static pbl_cond sealTimerWake = PBL_COND_INIT;
+
+static void seal_timer_main(void *arg)
+{
+    (void)arg;
+    while (!pbl_load64(&sealTimerStop))
+    {
+        int64_t delay = pbl_load64(&blockMaxDelayMs);
+        if (delay <= 0) break;
+
+        // Sleep until the oldest pending transaction is due, or a full delay if none.
+        int64_t since = pbl_load64(&pendingSince);
+        int64_t wait = delay;
+        if (since != 0)
+        {
+            wait = since + delay - pbl_now_ms();
+            if (wait < 1) wait = 1;
+        }
+
+        pbl_mutex_lock(&sealTimerLock);
+        if (!pbl_load64(&sealTimerStop))
+            pbl_cond_timedwait_ms(&sealTimerWake, &sealTimerLock, (long)wait);
+        pbl_mutex_unlock(&sealTimerLock);
+
+        sealPendingBlocks(0); // seals everything if the oldest has expired
+        flush_ledger();
+    }
+}
+
+static void stop_seal_timer()
+{
+    if (!sealTimerRunning) return;
+    pbl_store64(&sealTimerStop, 1);
+    pbl_mutex_lock(&sealTimerLock);
+    pbl_cond_signal(&sealTimerWake);
+    pbl_mutex_unlock(&sealTimerLock);
+    pbl_thread_join(sealTimerThread);
+    sealTimerRunning = 0;
+}
+
+// Appends a transaction to the pending ring and sets *ticket to its place
+// in it (for await_sealed()). Callers enqueue before they
+// touch any balance (while holding the account stripe), so a transaction is
+// never applied without being recorded, and the ledger order for each
+// account matches the order its balance changed in. A full ring is sealed
+// early (in smaller blocks) to make room.
+// Returns 0 on success, 2 if the ring cannot be allocated or no room can be made.
+static int enqueueTransaction(int fromAcc, int toAcc, float amount, const char* remark, int64_t* ticket) {
+    if (ensure_pending_ring() != 0) return 2;
+
+    Transaction t;
+    t.txID = 0; // assigned when sealed
+    t.fromAcc = fromAcc;
+    t.toAcc = toAcc;
+    t.amount = amount;
+    strncpy(t.remark, remark, sizeof(t.remark)-1);
+    t.remark[sizeof(t.remark)-1] = 0;
+    t.timestamp = timestamp_now_us();
+
+    while (mpsc_ring_push(&pendingRing, &t, ticket) != 0) {
+        if (pbl_mutex_trylock(&chainLock) == 0) {
+            int failed = sealFromRing(1, mpsc_ring_size(&pendingRing));
+            pbl_mutex_unlock(&chainLock);
+            if (failed) return 2;
+        } else {
+            pbl_thread_yield(); // someone else is sealing
+        }
+    }
+    if (pbl_load64(&pendingSince) == 0)
+        pbl_cas64(&pendingSince, 0, pbl_now_ms());
+    return 0;
+}
+
+// ---- STATE LOG ----
+// Account and user mutations, one record each (a transfer's two balances,
+// or a whole batch's, share one). A record is a run of operations, each a
+// kind byte followed by its fields (integers little-endian, text as a u8
+// length and the bytes):
+//   STATE_ACCOUNT  accID u32 | balance bits u32 | name | phone   (whole account)
+//   STATE_BALANCE  accID u32 | balance bits u32
+//   STATE_DELETE   accID u32
+//   STATE_USER     id u32 | username | password
+//   STATE_OPENED   accID u32 | first txID u32   (follows a create's STATE_ACCOUNT)
+// Every operation states a value rather than a change, so replaying a record
+// twice, or onto a snapshot that already has it, does no harm. Records for
+// one account are appended while its stripe (or accountsLock) is held, so
+// they are in the order its fields changed.
+//
+// A checkpoint moves the log aside (state.wal -> state.wal.old), writes fresh
+// snapshots while mutations go on into the new state.wal, then deletes the
+// old file. Startup loads the snapshots and replays state.wal.old (if a
+// checkpoint was cut short) and state.wal on top.
+#define STATE_ACCOUNT 1
+#define STATE_BALANCE 2
+#define STATE_DELETE 3
+#define STATE_USER 4
+#define STATE_OPENED 5
+#define STATE_BALANCE_BYTES (1 + 4 + 4)
+#define STATE_RECORD_MAX 128 // the longest single operation (a user)
+
+#define DEFAULT_CHECKPOINT_MS 60000
+#define DEFAULT_CHECKPOINT_BYTES (64 << 20)
+#define CHECKPOINT_POLL_MS 250
+
+static pbl_mutex checkpointLock = PBL_MUTEX_INIT; // one checkpoint at a time
+static int64_t checkpointCount = 0;               // guarded by checkpointLock
+static int64_t checkpointLastMs = 0;
+static volatile int64_t checkpointIntervalMs = DEFAULT_CHECKPOINT_MS;
+static volatile int64_t checkpointMaxBytes = DEFAULT_CHECKPOINT_BYTES;
+static pbl_thread checkpointThread;
+static int checkpointRunning = 0;
+static volatile int64_t checkpointStop = 0;
+static pbl_mutex checkpointWakeLock = PBL_MUTEX_INIT;
+static pbl_cond checkpointWake = PBL_COND_INIT;
+
+static unsigned char* put_text(unsigned char* p, const char* text)
+{
+    size_t len = strlen(text);
+    *p++ = (unsigned char)len;
+    memcpy(p, text, len);
+    return p + len;
+}
+
+static unsigned char* put_balance(unsigned char* p, const account* acc)
+{
+    uint32_t bits;
+    memcpy(&bits, &acc->balance, sizeof(bits));
+    *p++ = STATE_BALANCE;
+    p = put_le32(p, (uint32_t)acc->accID);
+    return put_le32(p, bits);
+}
+
+static unsigned char* put_account(unsigned char* p, const account* acc)
+{
+    uint32_t bits;
+    memcpy(&bits, &acc->balance, sizeof(bits));
+    *p++ = STATE_ACCOUNT;
+    p = put_le32(p, (uint32_t)acc->accID);
+    p = put_le32(p, bits);
+    p = put_text(p, acc->name);
+    return put_text(p, acc->phno);
+}
+
+static void log_account(const account* acc)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    unsigned char* rec = record_log_begin(&stateLog, STATE_RECORD_MAX);
+    if (rec == NULL) return;
+    unsigned char* p = put_account(rec, acc);
+    record_log_end(&stateLog, (uint32_t)(p - rec));
+}
+
+// A new account and where its statement starts, in one record.
+static void log_create(const account* acc, int historyFrom)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    unsigned char* rec = record_log_begin(&stateLog, STATE_RECORD_MAX);
+    if (rec == NULL) return;
+    unsigned char* p = put_account(rec, acc);
+    *p++ = STATE_OPENED;
+    p = put_le32(p, (uint32_t)acc->accID);
+    p = put_le32(p, (uint32_t)historyFrom);
+    record_log_end(&stateLog, (uint32_t)(p - rec));
+}
+
+static void log_balances(account* const* accs, int n)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    unsigned char* rec = record_log_begin(&stateLog, (uint32_t)n * STATE_BALANCE_BYTES);
+    if (rec == NULL) return;
+    unsigned char* p = rec;
+    for (int i = 0; i < n; i++)
+        p = put_balance(p, accs[i]);
+    record_log_end(&stateLog, (uint32_t)(p - rec));
+}
+
+// The final balance of every account a batch changed (repeats included).
+// Every stripe the batch touched is still held.
+static void log_batch(const batch_op* ops, int count)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    uint64_t n = 0;
+    for (int i = 0; i < count; i++)
+        if (ops[i].result == 0) n += ops[i].type == BATCH_TRANSFER ? 2 : 1;
+    uint64_t bytes = n * STATE_BALANCE_BYTES;
+    unsigned char* rec = record_log_begin(&stateLog, bytes > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)bytes);
+    if (rec == NULL) return;
+    unsigned char* p = rec;
+    for (int i = 0; i < count; i++)
+    {
+        if (ops[i].result != 0) continue;
+        p = put_balance(p, findaccount(ops[i].id));
+        if (ops[i].type == BATCH_TRANSFER) p = put_balance(p, findaccount(ops[i].toID));
+    }
+    record_log_end(&stateLog, (uint32_t)(p - rec));
+}
+
+static void log_delete(int id)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    unsigned char* rec = record_log_begin(&stateLog, 5);
+    if (rec == NULL) return;
+    rec[0] = STATE_DELETE;
+    put_le32(rec + 1, (uint32_t)id);
+    record_log_end(&stateLog, 5);
+}
+
+static void log_user(const user* u)
+{
+    if (!pbl_load64(&stateOpen)) return;
+    unsigned char* rec = record_log_begin(&stateLog, STATE_RECORD_MAX);
+    if (rec == NULL) return;
+    unsigned char* p = rec;
+    *p++ = STATE_USER;
+    p = put_le32(p, (uint32_t)u->id);
+    p = put_text(p, u->username);
+    p = put_text(p, u->password);
+    record_log_end(&stateLog, (uint32_t)(p - rec));
+}
+
+// Returns once every state record and block so far is flushed.
+static void flush_logs()
+{
+    if (pbl_load64(&stateOpen)) record_log_flush(&stateLog);
+    flush_ledger();
+}
+
+// Reads a u8-length text field into out[max]. Returns the next field, or NULL if it does not fit.
+static const unsigned char* get_text(const unsigned char* p, const unsigned char* end, char* out, size_t max)
+{
+    if (p >= end || *p >= max || end - p - 1 < *p) return NULL;
+    size_t len = *p++;
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return p + len;
+}
+
+// Checks a record's operations and, with 'apply' set, applies them.
+// Caller holds accountsLock and usersLock for writing.
+// Returns 0 on success, 1 if the record is malformed, 2 if memory runs out.
+static int replay_state_ops(const unsigned char* p, const unsigned char* end, int apply)
+{
+    while (p < end)
+    {
+        int kind = *p++;
+        if (kind == STATE_ACCOUNT || kind == STATE_BALANCE)
+        {
+            if (end - p < 8) return 1;
+            account acc;
+            memset(&acc, 0, sizeof(acc));
+            uint32_t bits = get_le32(p + 4);
+            acc.accID = (int)get_le32(p);
+            memcpy(&acc.balance, &bits, sizeof(acc.balance));
+            p += 8;
+            if (kind == STATE_ACCOUNT)
+            {
+                p = get_text(p, end, acc.name, sizeof(acc.name));
+                if (p != NULL) p = get_text(p, end, acc.phno, sizeof(acc.phno));
+                if (p == NULL) return 1;
+            }
+            if (!apply) continue;
+            account *cur = findaccount(acc.accID);
+            if (kind == STATE_BALANCE)
+            {
+                if (cur != NULL) cur->balance = acc.balance;
+            }
+            else if (cur != NULL)
+            {
+                *cur = acc;
+            }
+            else if (insertaccount(&acc) != 0)
+            {
+                return 2;
+            }
+        }
+        else if (kind == STATE_DELETE)
+        {
+            if (end - p < 4) return 1;
+            if (apply) removeaccount((int)get_le32(p));
+            p += 4;
+        }
+        else if (kind == STATE_OPENED)
+        {
+            if (end - p < 8) return 1;
+            account_slot *slot = apply ? findslot((int)get_le32(p)) : NULL;
+            if (slot != NULL) slot->historyFrom = (int)get_le32(p + 4);
+            p += 8;
+        }
+        else if (kind == STATE_USER)
+        {
+            if (end - p < 4) return 1;
+            user u;
+            memset(&u, 0, sizeof(u));
+            u.id = (int)get_le32(p);
+            p = get_text(p + 4, end, u.username, sizeof(u.username));
+            if (p != NULL) p = get_text(p, end, u.password, sizeof(u.password));
+            if (p == NULL) return 1;
+            uint32_t row;
+            if (!apply) continue;
+            if (hash_index_find(&userIndex, u.id, &row) == 0) *userat((int)row) = u;
+            else if (appenduser(&u) != 0) return 2;
+        }
+        else
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// record_log_visit for the state log. A snapshot that ran out of memory
+// budget aborts the open, so nothing is checkpointed (and lost) until the
+// budget is raised.
+static int replay_state(const unsigned char* rec, uint32_t len, void* arg)
+{
+    (void)arg;
+    int result = replay_state_ops(rec, rec + len, 0);
+    return result != 0 ? result : replay_state_ops(rec, rec + len, 1);
+}
+
+// Replays state.wal.old (if there is one) and state.wal onto the loaded
+// snapshots and keeps state.wal open for new records.
+static void open_state_log()
+{
+    int mode = (int)pbl_load64(&ledgerSyncMode);
+    pbl_rwlock_wrlock(&accountsLock);
+    pbl_rwlock_wrlock(&usersLock);
+    int ok = 1;
+    FILE *old = fopen(STATE_LOG_OLD, "rb");
+    if (old != NULL)
+    {
+        fclose(old);
+        record_log prior;
+        int opened = record_log_open(&prior, STATE_LOG_OLD, mode, replay_state, NULL);
+        if (opened == 0) record_log_close(&prior);
+        ok = opened == 0;
+        stateCorrupt = opened == 3;
+    }
+    int opened = ok ? record_log_open(&stateLog, STATE_LOG_FILE, mode, replay_state, NULL) : 2;
+    if (opened == 0) pbl_store64(&stateOpen, 1);
+    if (opened == 3) stateCorrupt = 1;
+    pbl_rwlock_wrunlock(&usersLock);
+    pbl_rwlock_wrunlock(&accountsLock);
+}
+
+// Writes fresh snapshots and drops the log records they cover. Without an
+// open state log (or if it failed) only the snapshots are written.
+// Returns 0 on success, 2 if a snapshot or the log rotation failed.
+static int run_checkpoint()
+{
+    pbl_mutex_lock(&checkpointLock);
+    int64_t started = pbl_now_ms();
+    int open = (int)pbl_load64(&stateOpen);
+    int result = 0;
+    if (open)
+    {
+        // A checkpoint cut short leaves state.wal.old behind; it is still
+        // needed, and state.wal then simply waits for the next checkpoint.
+        FILE *old = fopen(STATE_LOG_OLD, "rb");
+        if (old != NULL) fclose(old);
+        else if (record_log_rotate(&stateLog, STATE_LOG_OLD) != 0) result = 2;
+    }
+    if (syncaccountsfile() != 0 || saveuserstofile(USERS_FILE, 1) != 0) result = 2;
+    if (open && result == 0) remove(STATE_LOG_OLD);
+    if (result == 0)
+    {
+        checkpointCount++;
+        checkpointLastMs = pbl_now_ms() - started;
+    }
+    pbl_mutex_unlock(&checkpointLock);
+    return result;
+}
+
+// Background thread: checkpoints once the state log has grown past
+// checkpointMaxBytes, or has anything in it checkpointIntervalMs after the last checkpoint.
+static void checkpoint_main(void *arg)
+{
+    (void)arg;
+    int64_t last = pbl_now_ms();
+    for (;;)
+    {
+        pbl_mutex_lock(&checkpointWakeLock);
+        if (!pbl_load64(&checkpointStop))
+            pbl_cond_timedwait_ms(&checkpointWake, &checkpointWakeLock, CHECKPOINT_POLL_MS);
+        pbl_mutex_unlock(&checkpointWakeLock);
+        if (pbl_load64(&checkpointStop)) break;
+
+        int64_t size = record_log_size(&stateLog);
+        int64_t interval = pbl_load64(&checkpointIntervalMs);
+        int64_t maxBytes = pbl_load64(&checkpointMaxBytes);
+        int64_t now = pbl_now_ms();
+        if (size > 0 && ((interval > 0 && now - last >= interval) || (maxBytes > 0 && size >= maxBytes)))
+        {
+            run_checkpoint();
+            last = now;
+        }
+    }
+}
+
+static void stop_checkpointer()
+{
+    if (!checkpointRunning) return;
+    pbl_store64(&checkpointStop, 1);
+    pbl_mutex_lock(&checkpointWakeLock);
+    pbl_cond_signal(&checkpointWake);
+    pbl_mutex_unlock(&checkpointWakeLock);
+    pbl_thread_join(checkpointThread);
+    checkpointRunning = 0;
+}
+
+// ---- SNAPSHOTS ----
+// A snapshot is a point-in-time image of accounts, users and the chain in
+// the files they are loaded from, under SNAPSHOT_SUFFIX names
+// (accounts.dat.snap, users.dat.snap, ledger.log.snap). With every writer
+// locked out for a moment, the process forks; the child writes the image from
+// its copy-on-write view of memory while the parent unlocks and carries on.
+// The one exception is a mapped account slab: pages no one has written are
+// still the file's, and a checkpoint may rewrite those while the child runs,
+// so account writes stay paused until the child has copied the slab into its
+// own memory (a memcpy, no I/O).
+#define SNAPSHOT_SUFFIX ".snap"
+#define LEDGER_SNAPSHOT_FLUSH 1024 // blocks between the image writer's flushes
+#define SNAPSHOT_POLL_MS 250
+
+typedef struct snapshot_report {
+    int status;        // 0 = the image is complete
+    int64_t cowBytes;  // the child's private dirty bytes, less its own slab copy (-1 = unknown)
+} snapshot_report;
+
+static pbl_mutex snapshotLock = PBL_MUTEX_INIT; // guards the stats below and snapshotRequested
+static snapshot_stats snapshotStats;
+static int snapshotRequested = 0;
+static volatile int64_t snapshotIntervalMs = 0; // 0 = only on request
+static pbl_thread snapshotThread;
+static int snapshotRunning = 0;
+static volatile int64_t snapshotStop = 0;
+static pbl_cond snapshotWake = PBL_COND_INIT;
+
+static int reject_record(const unsigned char* rec, uint32_t len, void* arg)
+{
+    (void)rec;
+    (void)len;
+    (void)arg;
+    return 1;
+}
+
+// Writes the whole chain to 'path' in the ledger log format (through
+// 'path'.tmp). Only for the snapshot child: it takes no locks.
+static int write_ledger_image(const char* path)
+{
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    record_log image;
+    remove(tmp); // left behind by a snapshot that died
+    if (record_log_open(&image, tmp, RECORD_LOG_SYNC, reject_record, NULL) != 0) return 1;
+    int ok = 1;
+    int64_t n = 0;
+    for (Block* blk = blockchainHead; blk != NULL && ok; blk = blk->next)
+    {
+        ok = append_block(&image, blk) == 0;
+        if (ok && ++n % LEDGER_SNAPSHOT_FLUSH == 0) ok = record_log_flush(&image) == 0;
+    }
+    ok = ok && record_log_flush(&image) == 0;
+    record_log_close(&image);
+    if (!ok || pbl_replace_file(tmp, path) != 0)
+    {
+        remove(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+// Replaces the mapped slab with a heap copy of its used slots. Snapshot child only.
+static int copy_slab(int64_t *bytes)
+{
+    seg_array copy;
+    seg_array_init(&copy, sizeof(account_slot));
+    if (seg_array_reserve(&copy, slabUsed) != 0) return 1;
+    for (uint32_t h = 0; h < slabUsed; h += SEG_CHUNK_ELEMS)
+    {
+        uint32_t n = slabUsed - h < SEG_CHUNK_ELEMS ? slabUsed - h : SEG_CHUNK_ELEMS;
+        memcpy(seg_array_at(&copy, h), seg_array_at(&accountSlab, h), (size_t)n * sizeof(account_slot));
+    }
+    accountSlab = copy;
+    *bytes = (int64_t)slabUsed * (int64_t)sizeof(account_slot);
+    return 0;
+}
+
+// The snapshot child: tells the parent when it may let account writers go,
+// writes the image, reports and exits.
+static void snapshot_child(pbl_child *child)
+{
+    snapshot_report report;
+    int64_t ownBytes = 0;
+    report.status = 0;
+    if (accountsMapped && copy_slab(&ownBytes) != 0) report.status = 1;
+    char ready = 1;
+    pbl_child_send(child, &ready, 1);
+
+    if (report.status == 0)
+    {
+        if (saveaccountstofile(ACCOUNTS_FILE SNAPSHOT_SUFFIX, 0) != 0 ||
+            saveuserstofile(USERS_FILE SNAPSHOT_SUFFIX, 0) != 0 ||
+            write_ledger_image(LEDGER_FILE SNAPSHOT_SUFFIX) != 0)
+            report.status = 1;
+    }
+    int64_t dirty = pbl_private_dirty_bytes();
+    report.cowBytes = dirty < 0 ? -1 : (dirty > ownBytes ? dirty - ownBytes : 0);
+    pbl_child_send(child, &report, sizeof(report));
+    pbl_child_exit(report.status);
+}
+
+// Seals what is pending, forks a snapshot child and waits for it. Returns 0
+// if the image was written, 2 if sealing or forking failed (or is
+// unsupported) or the child failed.
+static int run_snapshot()
+{
+    int64_t started = pbl_now_ms();
+    pbl_child child;
+    pbl_rwlock_wrlock(&accountsLock);
+    pbl_rwlock_wrlock(&usersLock);
+    pbl_mutex_lock(&chainLock);
+    // Producers push under accountsLock, so the ring is complete here: seal
+    // all of it so the image's chain covers every balance change it holds.
+    int sealed = pbl_load64(&pendingRingState) != 2 ||
+                 sealFromRing(1, mpsc_ring_size(&pendingRing)) == 0;
+    int forked = sealed ? pbl_fork(&child) : -1;
+    if (forked == 0) snapshot_child(&child); // does not return
+    char ready = 0;
+    if (forked == 1 && accountsMapped) pbl_child_receive(&child, &ready, 1);
+    pbl_mutex_unlock(&chainLock);
+    pbl_rwlock_wrunlock(&usersLock);
+    pbl_rwlock_wrunlock(&accountsLock);
+    flush_ledger();
+    int64_t pausedMs = pbl_now_ms() - started;
+
+    snapshot_report report;
+    report.status = 1;
+    report.cowBytes = -1;
+    if (forked == 1)
+    {
+        if (pbl_child_receive(&child, &report, sizeof(report)) != 0) report.status = 1;
+        if (pbl_child_wait(&child) != 0) report.status = 1;
+    }
+
+    pbl_mutex_lock(&snapshotLock);
+    snapshotStats.running = 0;
+    if (forked == 1 && report.status == 0)
+    {
+        snapshotStats.snapshots++;
+        snapshotStats.lastMs = pbl_now_ms() - started;
+        snapshotStats.lastPauseMs = pausedMs;
+        snapshotStats.lastCowBytes = report.cowBytes;
+        snapshotStats.lastCowPages = report.cowBytes < 0 ? -1 : report.cowBytes / pbl_page_size();
+    }
+    else
+    {
+        snapshotStats.failures++;
+    }
+    pbl_mutex_unlock(&snapshotLock);
+    if (!sealed) fprintf(stderr, "snapshot: could not seal the pending transactions\n");
+    else if (forked != 1) fprintf(stderr, "snapshot: could not fork\n");
+    else if (report.status != 0) fprintf(stderr, "snapshot: the child could not write the image\n");
+    return forked == 1 && report.status == 0 ? 0 : 2;
+}
+
+// Background thread: snapshots on request, and every snapshotIntervalMs if set.
+static void snapshot_main(void *arg)
+{
+    (void)arg;
+    int64_t last = pbl_now_ms();
+    for (;;)
+    {
+        pbl_mutex_lock(&snapshotLock);
+        if (!pbl_load64(&snapshotStop) && !snapshotRequested)
+            pbl_cond_timedwait_ms(&snapshotWake, &snapshotLock, SNAPSHOT_POLL_MS);
+        int64_t interval = pbl_load64(&snapshotIntervalMs);
+        int64_t now = pbl_now_ms();
+        int due = snapshotRequested || (interval > 0 && now - last >= interval);
+        if (due)
+        {
+            snapshotRequested = 0;
+            snapshotStats.running = 1;
+        }
+        pbl_mutex_unlock(&snapshotLock);
+        if (pbl_load64(&snapshotStop)) break;
+        if (!due) continue;
+        run_snapshot();
+        last = now;
+    }
+    pbl_mutex_lock(&snapshotLock);
+    snapshotStats.running = 0;
+    snapshotRequested = 0;
+    pbl_mutex_unlock(&snapshotLock);
+}
+
+static void stop_snapshotter()
+{
+    if (!snapshotRunning) return;
+    pbl_store64(&snapshotStop, 1);
+    pbl_mutex_lock(&snapshotLock);
+    pbl_cond_signal(&snapshotWake);
+    pbl_mutex_unlock(&snapshotLock);
+    pbl_thread_join(snapshotThread);
+    snapshotRunning = 0;
+}
+
+// --- Account mutations ---
+// Each apply_* function is the whole of one mutation. In locking mode they
+// run on the caller's thread; in sequencer mode only the sequencer runs them.
+// Apart from create/delete (which take accountsLock for writing), the caller
+// must hold accountsLock for reading.
+
+static int apply_create(const account *newacc)
+{
+    pbl_rwlock_wrlock(&accountsLock);
+    int result = insertaccount(newacc);
+    if (result == 0)
+    {
+        // A reused ID's earlier transactions stay out of the new statement.
+        pbl_mutex_lock(&chainLock);
+        int historyFrom = next_tx_id();
+        pbl_mutex_unlock(&chainLock);
+        findslot(newacc->accID)->historyFrom = historyFrom;
+        log_create(newacc, historyFrom);
+    }
+    pbl_rwlock_wrunlock(&accountsLock);
+    return result;
+}
+
+static int apply_delete(int id)
+{
+    pbl_rwlock_wrlock(&accountsLock);
+    int result = removeaccount(id); // 1 = Not found
+    if (result == 0)
+    {
+        log_delete(id);
+        forget_history(id);
+    }
+    pbl_rwlock_wrunlock(&accountsLock);
+    return result;
+}
+
+static int apply_update_name(int id, const char* newName)
+{
+    account *acc = findaccount(id);
+    if (acc == NULL) return 1; // 1 = Not found
+    account_stripe *stripe = stripe_for(id);
+    stripe_lock(stripe);
+    stripe_write_begin(stripe);
+    strncpy(acc->name, newName, sizeof(acc->name) - 1);
+    acc->name[sizeof(acc->name) - 1] = 0;
+    log_account(acc);
+    stripe_write_end(stripe);
+    stripe_unlock(stripe);
+    return 0;
+}
+
+static int apply_update_phone(int id, const char* newPhone)
+{
+    account *acc = findaccount(id);
+    if (acc == NULL) return 1; // 1 = Not found
+    account_stripe *stripe = stripe_for(id);
+    stripe_lock(stripe);
+    stripe_write_begin(stripe);
+    strncpy(acc->phno, newPhone, sizeof(acc->phno) - 1);
+    acc->phno[sizeof(acc->phno) - 1] = 0;
+    log_account(acc);
+    stripe_write_end(stripe);
+    stripe_unlock(stripe);
+    return 0;
+}
+
+static int apply_update_balance(int id, float newBalance)
+{
+    account *acc = findaccount(id);
+    if (acc == NULL) return 1; // 1 = Not found
+    account_stripe *stripe = stripe_for(id);
+    stripe_lock(stripe);
+    stripe_write_begin(stripe);
+    acc->balance = newBalance;
+    log_balances(&acc, 1);
+    stripe_write_end(stripe);
+    stripe_unlock(stripe);
+    return 0;
+}
+
+static int apply_deposit(int id, float amount, int64_t* ticket)
+{
+    account *acc = findaccount(id);
+    if (acc == NULL) return 1; // 1 = Account not found
+    if (amount <= 0) return 2; // 2 = Invalid amount
+
+    int result = 0;
+    account_stripe *stripe = stripe_for(id);
+    stripe_lock(stripe);
+    char remark[100];
+    snprintf(remark, sizeof(remark), "Deposit by %s", acc->name);
+    if (enqueueTransaction(0, acc->accID, amount, remark, ticket) != 0)
+    {
+        result = 4; // 4 = Ledger out of memory
+    }
+    else
+    {
+        stripe_write_begin(stripe);
+        acc->balance += amount;
+        log_balances(&acc, 1);
+        stripe_write_end(stripe);
+    }
+    stripe_unlock(stripe);
+    return result;
+}
+
+static int apply_withdraw(int id, float amount, int64_t* ticket)
+{
+    account *acc = findaccount(id);
+    if (acc == NULL) return 1; // 1 = Account not found
+    if (amount <= 0) return 2; // 2 = Invalid amount
+
+    int result = 0;
+    account_stripe *stripe = stripe_for(id);
+    stripe_lock(stripe);
+    if (amount > acc->balance)
+    {
+        result = 3; // 3 = Insufficient funds
+    }
+    else
+    {
+        char remark[100];
+        snprintf(remark, sizeof(remark), "Withdrawal by %s", acc->name);
+        if (enqueueTransaction(acc->accID, 0, amount, remark, ticket) != 0)
+        {
+            result = 4; // 4 = Ledger out of memory
+        }
+        else
+        {
+            stripe_write_begin(stripe);
+            acc->balance -= amount;
+            log_balances(&acc, 1);
+            stripe_write_end(stripe);
+        }
+    }
+    stripe_unlock(stripe);
+    return result;
+}
+
+static int apply_transfer(int fromID, int toID, float amount, int64_t* ticket)
+{
+    account *from = findaccount(fromID);
+    if (from == NULL) return 1; // 1 = Sender not found
+    account *to = findaccount(toID);
+    if (to == NULL) return 2;   // 2 = Receiver not found
+
+    // Always lock the lower stripe first so two opposite transfers cannot deadlock.
+    account_stripe *first = stripe_for(fromID);
+    account_stripe *second = stripe_for(toID);
+    if (second < first)
+    {
+        account_stripe *tmp = first;
+        first = second;
+        second = tmp;
+    }
+    stripe_lock(first);
+    if (second != first) stripe_lock(second);
+
+    int result = 0;
+    if (amount <= 0 || amount > from->balance)
+    {
+        result = 3; // 3 = Invalid amount or insufficient funds
+    }
+    else
+    {
+        char remark[100];
+        snprintf(remark, sizeof(remark), "Transfer %d->%d", fromID, toID);
+        if (enqueueTransaction(fromID, toID, amount, remark, ticket) != 0)
+        {
+            result = 4; // 4 = Ledger out of memory
+        }
+        else
+        {
+            stripe_write_begin(first);
+            if (second != first) stripe_write_begin(second);
+            from->balance -= amount;
+            to->balance += amount;
+            account *both[2] = { from, to };
+            log_balances(both, 2);
+            if (second != first) stripe_write_end(second);
+            stripe_write_end(first);
+        }
+    }
+
+    if (second != first) stripe_unlock(second);
+    stripe_unlock(first);
+    return result;
+}
+
+// One operation of a batch; every stripe it touches is already held. On
+// success fills in 't' (all but txID and timestamp) and changes the balances.
+static int apply_batch_op(const batch_op *op, Transaction *t)
+{
+    account *acc = findaccount(op->id);
+    if (op->type == BATCH_DEPOSIT)
+    {
+        if (acc == NULL) return 1;
+        if (op->amount <= 0) return 2;
+        t->fromAcc = 0;
+        t->toAcc = op->id;
+        snprintf(t->remark, sizeof(t->remark), "Deposit by %s", acc->name);
+        acc->balance += op->amount;
+    }
+    else if (op->type == BATCH_WITHDRAW)
+    {
+        if (acc == NULL) return 1;
+        if (op->amount <= 0) return 2;
+        if (op->amount > acc->balance) return 3;
+        t->fromAcc = op->id;
+        t->toAcc = 0;
+        snprintf(t->remark, sizeof(t->remark), "Withdrawal by %s", acc->name);
+        acc->balance -= op->amount;
+    }
+    else if (op->type == BATCH_TRANSFER)
+    {
+        if (acc == NULL) return 1;
+        account *to = findaccount(op->toID);
+        if (to == NULL) return 2;
+        if (op->amount <= 0 || op->amount > acc->balance) return 3;
+        t->fromAcc = op->id;
+        t->toAcc = op->toID;
+        snprintf(t->remark, sizeof(t->remark), "Transfer %d->%d", op->id, op->toID);
+        acc->balance -= op->amount;
+        to->balance += op->amount;
+    }
+    else
+    {
+        return 5; // 5 = Unknown operation
+    }
+    t->amount = op->amount;
+    return 0;
+}
+
+// Frees blocks[from..count) and the array itself.
+static void free_batch_blocks(Block **blocks, int from, int count)
+{
+    for (int i = from; i < count; i++) free(blocks[i]);
+    free(blocks);
+}
+
+// Applies a whole batch under one acquisition of each stripe it touches and
+// seals its transactions behind whatever was already pending, in as few
+// blocks as the byte cap allows. The blocks are allocated up front, so once
+// an operation has changed a balance it can no longer fail to be recorded.
+static int apply_batch(batch_op *ops, int count)
+{
+    int perBlock = block_capacity(1);
+    if (perBlock == 0 || perBlock > count) perBlock = count;
+    int blockTotal = (count + perBlock - 1) / perBlock;
+    Block **blocks = (Block **)calloc((size_t)blockTotal, sizeof(Block *));
+    int allocated = 0;
+    while (blocks != NULL && allocated < blockTotal)
+    {
+        int room = (allocated == blockTotal - 1) ? count - allocated * perBlock : perBlock;
+        if ((blocks[allocated] = allocBlock(room)) == NULL) break;
+        allocated++;
+    }
+    if (blocks == NULL || allocated < blockTotal)
+    {
+        if (blocks != NULL) free_batch_blocks(blocks, 0, allocated);
+        for (int i = 0; i < count; i++) ops[i].result = 4;
+        return 4;
+    }
+
+    uint64_t touched[ACCOUNT_STRIPES / 64];
+    memset(touched, 0, sizeof(touched));
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t a = stripe_index(ops[i].id);
+        touched[a / 64] |= (uint64_t)1 << (a % 64);
+        if (ops[i].type == BATCH_TRANSFER)
+        {
+            uint32_t b = stripe_index(ops[i].toID);
+            touched[b / 64] |= (uint64_t)1 << (b % 64);
+        }
+    }
+    // Ascending stripe order, like every other multi-stripe lock.
+    for (uint32_t i = 0; i < ACCOUNT_STRIPES; i++)
+        if (touched[i / 64] & ((uint64_t)1 << (i % 64))) stripe_lock(&accountStripes[i]);
+    for (uint32_t i = 0; i < ACCOUNT_STRIPES; i++)
+        if (touched[i / 64] & ((uint64_t)1 << (i % 64))) stripe_write_begin(&accountStripes[i]);
+
+    int64_t timestamp = timestamp_now_us();
+    int applied = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Block *blk = blocks[applied / perBlock];
+        Transaction *t = &blk->transactions[applied % perBlock];
+        ops[i].result = apply_batch_op(&ops[i], t);
+        if (ops[i].result == 0)
+        {
+            t->timestamp = timestamp;
+            blk->transactionCount++;
+            applied++;
+        }
+    }
+    int used = (applied + perBlock - 1) / perBlock;
+    if (applied > 0) log_batch(ops, count);
+    for (uint32_t i = ACCOUNT_STRIPES; i-- > 0;)
+        if (touched[i / 64] & ((uint64_t)1 << (i % 64))) stripe_write_end(&accountStripes[i]);
+
+    if (applied > 0)
+    {
+        // Seal the backlog first (everything our accounts enqueued before we
+        // took their stripes is in it), then the batch, while the stripes are
+        // still held, so ledger order matches balance order. If the backlog
+        // cannot be sealed (out of memory) it lands after these blocks.
+        pbl_mutex_lock(&chainLock);
+        if (pbl_load64(&pendingRingState) == 2)
+            sealFromRing(1, mpsc_ring_size(&pendingRing));
+        for (int i = 0; i < applied; i++)
+            blocks[i / perBlock]->transactions[i % perBlock].txID = nextTxID++;
+        for (int i = 0; i < used; i++)
+            linkBlock(blocks[i]);
+        pbl_mutex_unlock(&chainLock);
+    }
+    for (uint32_t i = ACCOUNT_STRIPES; i-- > 0;)
+        if (touched[i / 64] & ((uint64_t)1 << (i % 64))) stripe_unlock(&accountStripes[i]);
+    free_batch_blocks(blocks, used, blockTotal);
+    return 0;
+}
+
+// --- Sequencer thread ---
+
+// Runs one command on the sequencer. accountsLock is read-held on entry and
+// exit. A transaction's ring ticket goes to *ticket.
+static int execute_command(const ledger_command *cmd, int64_t *ticket)
+{
+    int result = 0;
+    switch (cmd->type)
+    {
+    case CMD_CREATE:
+    case CMD_DELETE:
+        // Structural changes need the write lock; drop the batch's read lock around them.
+        pbl_rwlock_rdunlock(&accountsLock);
+        result = (cmd->type == CMD_CREATE) ? apply_create(cmd->newacc) : apply_delete(cmd->id);
+        pbl_rwlock_rdlock(&accountsLock);
+        break;
+    case CMD_UPDATE_NAME:    result = apply_update_name(cmd->id, cmd->text); break;
+    case CMD_UPDATE_PHONE:   result = apply_update_phone(cmd->id, cmd->text); break;
+    case CMD_UPDATE_BALANCE: result = apply_update_balance(cmd->id, cmd->amount); break;
+    case CMD_DEPOSIT:        result = apply_deposit(cmd->id, cmd->amount, ticket); break;
+    case CMD_WITHDRAW:       result = apply_withdraw(cmd->id, cmd->amount, ticket); break;
+    case CMD_TRANSFER:       result = apply_transfer(cmd->id, cmd->toID, cmd->amount, ticket); break;
+    case CMD_BATCH:          result = apply_batch(cmd->ops, cmd->id); break;
+    }
+    return result;
+}
+
+static void sequencer_main(void *arg)
+{
+    int cpu = (int)(intptr_t)arg;
+    if (cpu >= 0) pbl_thread_pin(cpu);
+
+    ledger_command *batch[SEQUENCER_BATCH];
+    int idle = 0;
+    for (;;)
+    {
+        int n = mpsc_ring_pop(&commandRing, batch, SEQUENCER_BATCH);
+        if (n == 0)
+        {
+            if (pbl_load64(&sequencerStop)) break; // only once the ring is drained
+            if (idle < waitSpins + WAIT_YIELDS)
+            {
+                if (idle++ < waitSpins) pbl_cpu_relax();
+                else pbl_thread_yield();
+                continue;
+            }
+            // Park. Producers check sequencerParked after publishing, and we
+            // re-check the ring after setting it, so a wakeup cannot be missed.
+            pbl_mutex_lock(&wakeLock);
+            pbl_store64(&sequencerParked, 1);
+            if (mpsc_ring_size(&commandRing) == 0 && !pbl_load64(&sequencerStop))
+                pbl_cond_timedwait_ms(&sequencerWake, &wakeLock, 100);
+            pbl_store64(&sequencerParked, 0);
+            pbl_mutex_unlock(&wakeLock);
+            idle = 0;
+            continue;
+        }
+        idle = 0;
+
+        int64_t last = -1; // the batch's latest ring ticket
+        pbl_rwlock_rdlock(&accountsLock);
+        for (int i = 0; i < n; i++)
+        {
+            int64_t ticket = -1;
+            batch[i]->result = execute_command(batch[i], &ticket);
+            if (batch[i]->result == 0 && ticket > last) last = ticket;
+        }
+        pbl_rwlock_rdunlock(&accountsLock);
+
+        // One seal and one ledger flush for the whole batch; callers see
+        // their transactions in the chain (and on disk).
+        if (last >= 0 && await_sealed(last) != 0)
+        {
+            for (int i = 0; i < n; i++)
+                if (batch[i]->result == 0 && batch[i]->type >= CMD_DEPOSIT && batch[i]->type <= CMD_TRANSFER)
+                    batch[i]->result = 4;
+        }
+        flush_logs();
+
+        // A caller may return (and its command go away) as soon as 'done' is set.
+        for (int i = 0; i < n; i++)
+            pbl_store64(&batch[i]->done, 1);
+        if (pbl_load64(&completionWaiters) > 0)
+        {
+            pbl_mutex_lock(&doneLock);
+            pbl_cond_broadcast(&commandDone);
+            pbl_mutex_unlock(&doneLock);
+        }
+    }
+}
+
+static ledger_command new_command(int type, int id)
+{
+    ledger_command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = type;
+    cmd.id = id;
+    return cmd;
+}
+
+// Publishes 'cmd' to the sequencer and blocks until it has been applied.
+static int submit_command(ledger_command *cmd)
+{
+    while (mpsc_ring_push(&commandRing, &cmd, NULL) != 0)
+        pbl_thread_yield(); // ring full: let the sequencer catch up
+    if (pbl_load64(&sequencerParked))
+    {
+        pbl_mutex_lock(&wakeLock);
+        pbl_cond_signal(&sequencerWake);
+        pbl_mutex_unlock(&wakeLock);
+    }
 
-    if (pendingCount >= BLOCK_CAP) {
-        addBlockFromPending();
+    for (int poll = 0; poll < waitSpins + WAIT_YIELDS; poll++)
+    {
+        if (pbl_load64(&cmd->done)) return cmd->result;
+        if (poll < waitSpins) pbl_cpu_relax();
+        else pbl_thread_yield();
     }
+    pbl_fetch_add64(&completionWaiters, 1);
+    pbl_mutex_lock(&doneLock);
+    while (!pbl_load64(&cmd->done))
+        pbl_cond_wait(&commandDone, &doneLock);
+    pbl_mutex_unlock(&doneLock);
+    pbl_fetch_add64(&completionWaiters, -1);
+    return cmd->result;
 }
 
 // ------------------------------------------- PUBLIC API FUNCTIONS -----------------------------------------------
@@ -240,24 +2471,67 @@ static void recordTransaction(int fromAcc, int toAcc, float amount, const char*
 void initialize_system()
 {
     loadaccountsfromfile();
+
+    pbl_rwlock_wrlock(&usersLock);
     loadusersfromfile();
-    // We create genesis block only if no chain is loaded (which we assume if head is NULL)
-    // A more robust system would load/save the chain from a file.
+    pbl_rwlock_wrunlock(&usersLock);
+
+    open_state_log();
+    if (pbl_load64(&stateOpen)) {
+        pbl_store64(&checkpointStop, 0);
+        checkpointRunning = pbl_thread_start(&checkpointThread, checkpoint_main, NULL) == 0;
+    }
+
+    // Rebuild the chain from the ledger log; a genesis block is only made
+    // (and logged) on the first run.
+    pbl_mutex_lock(&chainLock);
+    int opened = record_log_open(&ledgerLog, LEDGER_FILE, (int)pbl_load64(&ledgerSyncMode), replay_block, NULL);
+    if (opened == 0) pbl_store64(&ledgerOpen, 1);
+    ledgerCorrupt = opened == 3;
     createGenesisBlock();
+    pbl_mutex_unlock(&chainLock);
+    flush_ledger();
+
+    if (PBL_HAS_FORK) {
+        pbl_store64(&snapshotStop, 0);
+        snapshotRunning = pbl_thread_start(&snapshotThread, snapshot_main, NULL) == 0;
+    }
 }
 
 void shutdown_system()
 {
-    saveaccountstofile();
-    saveuserstofile();
-
-    // free account memory
-    for (int i = 0; i < accountcount; i++) {
-        free(accounts[i]);
-        accounts[i] = NULL;
+    stop_sequencer();
+    stop_seal_timer();
+
+    // Anything still pending goes into the chain before it is freed.
+    sealPendingBlocks(1);
+
+    // A last checkpoint leaves the state log empty.
+    stop_snapshotter();
+    stop_checkpointer();
+    run_checkpoint();
+    if (pbl_load64(&stateOpen)) {
+        pbl_store64(&stateOpen, 0);
+        record_log_close(&stateLog);
     }
 
+    pbl_rwlock_wrlock(&accountsLock);
+    resetaccounts();
+    pbl_rwlock_wrunlock(&accountsLock);
+
+    pbl_rwlock_wrlock(&usersLock);
+    seg_array_free(&userTable);
+    hash_index_free(&userIndex);
+    usercount = 0;
+    publish_users_usage();
+    pbl_rwlock_wrunlock(&usersLock);
+
     // free blockchain memory
+    pbl_mutex_lock(&chainLock);
+    if (pbl_load64(&ledgerOpen)) {
+        record_log_close(&ledgerLog);
+        pbl_store64(&ledgerOpen, 0);
+    }
     Block* cur = blockchainHead;
     while (cur != NULL) {
         Block* next = cur->next;
@@ -265,33 +2539,241 @@ void shutdown_system()
         cur = next;
     }
     blockchainHead = blockchainTail = NULL;
+    blockCount = 0;
+    pbl_store64(&indexedBlocks, 0);
+    seg_array_free(&blockIndex);
+    pbl_store64(&indexedTxs, 0);
+    seg_array_free(&txIndex);
+    reset_history();
+    pbl_mutex_unlock(&chainLock);
+
+    pbl_mutex_lock(&verifyLock);
+    free(verifiedCheckpoints);
+    verifiedCheckpoints = NULL;
+    checkpointCap = 0;
+    memset(&verifiedDigest, 0, sizeof(verifiedDigest));
+    verifiedTail = NULL;
+    verifiedCount = 0;
+    pbl_mutex_unlock(&verifyLock);
+
+    if (pbl_load64(&pendingRingState) == 2) mpsc_ring_free(&pendingRing);
+    pbl_store64(&pendingRingState, 0);
+    pbl_store64(&sealedThrough, 0);
+    pbl_store64(&pendingSince, 0);
+    pbl_store64(&pendingBytes, 0);
+}
+
+int start_sequencer(int cpu)
+{
+    if (pbl_load64(&sequencerMode)) return 0;
+    if (mpsc_ring_init(&commandRing, sizeof(ledger_command *), SEQUENCER_RING_SIZE) != 0) return 2;
+    waitSpins = pbl_cpu_count() > 1 ? WAIT_SPINS : 0;
+    pbl_store64(&sequencerStop, 0);
+    if (pbl_thread_start(&sequencerThread, sequencer_main, (void *)(intptr_t)cpu) != 0)
+    {
+        mpsc_ring_free(&commandRing);
+        return 2;
+    }
+    pbl_store64(&sequencerMode, 1);
+    return 0;
+}
+
+void stop_sequencer()
+{
+    if (!pbl_load64(&sequencerMode)) return;
+    pbl_store64(&sequencerStop, 1);
+    pbl_mutex_lock(&wakeLock);
+    pbl_cond_signal(&sequencerWake);
+    pbl_mutex_unlock(&wakeLock);
+    pbl_thread_join(sequencerThread); // drains the ring first
+    mpsc_ring_free(&commandRing);
+    pbl_store64(&sequencerMode, 0);
+}
+
+int set_block_policy(int maxTransactions, long maxDelayMs, size_t maxBytes)
+{
+    if (maxTransactions < 1 || maxDelayMs < 0) return 2; // 2 = Invalid input
+    if (maxBytes != 0 && maxBytes < sizeof(Transaction)) return 2;
+
+    pbl_store64(&blockMaxTx, maxTransactions);
+    pbl_store64(&blockMaxBytes, (int64_t)maxBytes);
+    pbl_store64(&blockMaxDelayMs, maxDelayMs);
+    if (maxDelayMs == 0)
+    {
+        stop_seal_timer();
+    }
+    else if (!sealTimerRunning)
+    {
+        pbl_store64(&sealTimerStop, 0);
+        if (pbl_thread_start(&sealTimerThread, seal_timer_main, NULL) != 0)
+        {
+            pbl_store64(&blockMaxDelayMs, 0);
+            return 2;
+        }
+        sealTimerRunning = 1;
+    }
+    else
+    {
+        // Re-arm the running timer for the new delay.
+        pbl_mutex_lock(&sealTimerLock);
+        pbl_cond_signal(&sealTimerWake);
+        pbl_mutex_unlock(&sealTimerLock);
+    }
+    // A smaller block may already be full.
+    sealPendingBlocks(0);
+    return 0;
+}
+
+int set_ledger_sync(int mode)
+{
+    if (mode != LEDGER_SYNC_WRITE && mode != LEDGER_SYNC_FULL) return 2;
+    pbl_store64(&ledgerSyncMode, mode);
+    return 0;
+}
+
+int get_ledger_log_stats(long long* blocks, long long* flushes, long long* droppedBytes)
+{
+    if (ledgerCorrupt) return 3;
+    if (!pbl_load64(&ledgerOpen)) return 1;
+    int64_t records, done;
+    record_log_stats(&ledgerLog, &records, &done);
+    if (blocks) *blocks = records;
+    if (flushes) *flushes = done;
+    if (droppedBytes) *droppedBytes = ledgerLog.dropped;
+    return 0;
+}
+
+int set_checkpoint_policy(long intervalMs, size_t maxLogBytes)
+{
+    if (intervalMs < 0) return 2;
+    pbl_store64(&checkpointIntervalMs, intervalMs);
+    pbl_store64(&checkpointMaxBytes, (int64_t)maxLogBytes);
+    return 0;
+}
+
+int perform_checkpoint()
+{
+    return run_checkpoint();
+}
+
+int get_checkpoint_stats(long long* logBytes, long long* checkpoints, long long* lastMs)
+{
+    if (stateCorrupt) return 3;
+    if (!pbl_load64(&stateOpen)) return 1;
+    if (logBytes) *logBytes = record_log_size(&stateLog);
+    pbl_mutex_lock(&checkpointLock);
+    if (checkpoints) *checkpoints = checkpointCount;
+    if (lastMs) *lastMs = checkpointLastMs;
+    pbl_mutex_unlock(&checkpointLock);
+    return 0;
+}
+
+int set_snapshot_interval(long intervalMs)
+{
+    if (intervalMs < 0) return 2;
+    pbl_store64(&snapshotIntervalMs, intervalMs);
+    return 0;
+}
+
+int start_snapshot()
+{
+    if (!snapshotRunning) return 2;
+    pbl_mutex_lock(&snapshotLock);
+    int busy = snapshotRequested || snapshotStats.running;
+    if (!busy)
+    {
+        snapshotRequested = 1;
+        pbl_cond_signal(&snapshotWake);
+    }
+    pbl_mutex_unlock(&snapshotLock);
+    return busy ? 1 : 0;
+}
+
+int get_snapshot_stats(snapshot_stats* out)
+{
+    if (!snapshotRunning) return 1;
+    pbl_mutex_lock(&snapshotLock);
+    *out = snapshotStats;
+    out->running = snapshotStats.running || snapshotRequested;
+    pbl_mutex_unlock(&snapshotLock);
+    return 0;
+}
+
+void set_memory_budget(size_t bytes)
+{
+    pbl_store64(&memoryBudget, (int64_t)bytes);
+}
+
+size_t get_memory_usage()
+{
+    return memory_in_use();
+}
+
+int reserve_capacity(long accounts, long users)
+{
+    if (accounts < 0 || users < 0) return 2;
+    if (accounts > 0xFFFFFFFEL) return 2;
+    if (users > 0xFFFFFFFEL) return 2;
+
+    pbl_rwlock_wrlock(&accountsLock);
+    pbl_rwlock_wrlock(&usersLock);
+
+    uint64_t slabTarget = (uint64_t)slabUsed > (uint64_t)accounts ? slabUsed : (uint64_t)accounts;
+    uint64_t userTarget = (uint64_t)usercount > (uint64_t)users ? (uint64_t)usercount : (uint64_t)users;
+    uint64_t slabChunks = (slabTarget + SEG_CHUNK_ELEMS - 1) / SEG_CHUNK_ELEMS;
+    uint64_t userChunks = (userTarget + SEG_CHUNK_ELEMS - 1) / SEG_CHUNK_ELEMS;
+
+    size_t extra = 0;
+    if (slabChunks * SEG_CHUNK_ELEMS > seg_array_capacity(&accountSlab))
+        extra += (size_t)(slabChunks * SEG_CHUNK_ELEMS - seg_array_capacity(&accountSlab)) * sizeof(account_slot);
+    if (userChunks * SEG_CHUNK_ELEMS > seg_array_capacity(&userTable))
+        extra += (size_t)(userChunks * SEG_CHUNK_ELEMS - seg_array_capacity(&userTable)) * sizeof(user);
+    extra += hash_index_reserve_cost(&accountIndex, (uint32_t)accounts);
+    extra += hash_index_reserve_cost(&userIndex, (uint32_t)users);
+
+    int result = 0;
+    if (!within_budget(extra)) {
+        result = 1;
+    } else if (seg_array_reserve(&accountSlab, (uint64_t)accounts) != 0 ||
+               seg_array_reserve(&userTable, (uint64_t)users) != 0 ||
+               hash_index_reserve(&accountIndex, (uint32_t)accounts) != 0 ||
+               hash_index_reserve(&userIndex, (uint32_t)users) != 0) {
+        result = 2;
+    }
+    publish_accounts_usage();
+    publish_users_usage();
+
+    pbl_rwlock_wrunlock(&usersLock);
+    pbl_rwlock_wrunlock(&accountsLock);
+    return result;
 }
 
 int perform_login(int accid, const char* username, const char* password)
 {
     if (!username || !password) return 0; // Safety check
 
-    for (int i = 0; i < usercount; i++)
+    int result = 0; // 0 = Failure
+    pbl_rwlock_rdlock(&usersLock);
+    uint32_t row;
+    if (hash_index_find(&userIndex, accid, &row) == 0)
     {
-        if (users[i].id == accid &&
-            strcmp(users[i].username, username) == 0 &&
-            strcmp(users[i].password, password) == 0)
+        const user *u = userat((int)row);
+        if (strcmp(u->username, username) == 0 &&
+            strcmp(u->password, password) == 0)
         {
-            return 1; // 1 = Success
+            result = 1; // 1 = Success
         }
     }
-    return 0; // 0 = Failure
+    pbl_rwlock_rdunlock(&usersLock);
+    return result;
 }
 
 int perform_register(int id, const char* username, const char* password)
 {
-    if (usercount >= max_user)
-    {
-        return 1; // 1 = User limit reached
-    }
     if (!username || !password) return 2; // Invalid input
 
     user newUser;
+    memset(&newUser, 0, sizeof(newUser));
     newUser.id = id;
     strncpy(newUser.username, username, sizeof(newUser.username) - 1);
     newUser.username[sizeof(newUser.username) - 1] = 0;
@@ -299,296 +2781,893 @@ int perform_register(int id, const char* username, const char* password)
     strncpy(newUser.password, password, sizeof(newUser.password) - 1);
     newUser.password[sizeof(newUser.password) - 1] = 0;
 
-    users[usercount++] = newUser;
-    return 0; // 0 = Success
+    // 0 = Success, 1 = Memory budget reached,
+    // 2 = Memory allocation failed, 3 = User ID already exists
+    pbl_rwlock_wrlock(&usersLock);
+    int result = appenduser(&newUser);
+    if (result == 0) log_user(&newUser);
+    pbl_rwlock_wrunlock(&usersLock);
+    if (result == 0) flush_logs();
+    return result;
 }
 
 int perform_create_account(int id, const char* name, const char* phno, float balance)
 {
-    if (accountcount >= max_accounts)
+    account newacc;
+    memset(&newacc, 0, sizeof(newacc));
+    newacc.accID = id;
+    strncpy(newacc.name, name, sizeof(newacc.name) - 1);
+    strncpy(newacc.phno, phno, sizeof(newacc.phno) - 1);
+    newacc.balance = balance;
+
+    // 0 = Success, 1 = Account limit reached,
+    // 2 = Memory allocation failed, 3 = Account ID already exists
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Account limit reached
+        ledger_command cmd = new_command(CMD_CREATE, id);
+        cmd.newacc = &newacc;
+        return submit_command(&cmd);
     }
-    if (findaccount(id) != NULL) {
-        return 3; // 3 = Account ID already exists
-    }
-
-    account *newacc = (account *)malloc(sizeof(account));
-    if (newacc == NULL)
-    {
-        return 2; // 2 = Memory allocation failed
-    }
-
-    newacc->accID = id;
-    strncpy(newacc->name, name, sizeof(newacc->name) - 1);
-    newacc->name[sizeof(newacc->name) - 1] = 0;
-
-    strncpy(newacc->phno, phno, sizeof(newacc->phno) - 1);
-    newacc->phno[sizeof(newacc->phno) - 1] = 0;
-
-    newacc->balance = balance;
-    accounts[accountcount++] = newacc;
-
-    return 0; // 0 = Success
+    int result = apply_create(&newacc);
+    if (result == 0) flush_logs();
+    return result;
 }
 
 int perform_update_account_name(int id, const char* newName)
 {
-    account *acc = findaccount(id);
-    if (acc == NULL)
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Not found
+        ledger_command cmd = new_command(CMD_UPDATE_NAME, id);
+        cmd.text = newName;
+        return submit_command(&cmd);
     }
-    strncpy(acc->name, newName, sizeof(acc->name) - 1);
-    acc->name[sizeof(acc->name) - 1] = 0;
-    return 0; // 0 = Success
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_update_name(id, newName);
+    pbl_rwlock_rdunlock(&accountsLock);
+    if (result == 0) flush_logs();
+    return result; // 0 = Success, 1 = Not found
 }
 
 int perform_update_account_phone(int id, const char* newPhone)
 {
-    account *acc = findaccount(id);
-    if (acc == NULL)
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Not found
+        ledger_command cmd = new_command(CMD_UPDATE_PHONE, id);
+        cmd.text = newPhone;
+        return submit_command(&cmd);
     }
-    strncpy(acc->phno, newPhone, sizeof(acc->phno) - 1);
-    acc->phno[sizeof(acc->phno) - 1] = 0;
-    return 0; // 0 = Success
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_update_phone(id, newPhone);
+    pbl_rwlock_rdunlock(&accountsLock);
+    if (result == 0) flush_logs();
+    return result; // 0 = Success, 1 = Not found
 }
 
 int perform_update_account_balance(int id, float newBalance)
 {
-    account *acc = findaccount(id);
-    if (acc == NULL)
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Not found
+        ledger_command cmd = new_command(CMD_UPDATE_BALANCE, id);
+        cmd.amount = newBalance;
+        return submit_command(&cmd);
     }
-    acc->balance = newBalance;
-    return 0; // 0 = Success
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_update_balance(id, newBalance);
+    pbl_rwlock_rdunlock(&accountsLock);
+    if (result == 0) flush_logs();
+    return result; // 0 = Success, 1 = Not found
 }
 
 int perform_delete_account(int id)
 {
-    int found = 0;
-    for (int i = 0; i < accountcount; i++)
+    if (pbl_load64(&sequencerMode))
     {
-        if (accounts[i]->accID == id)
-        {
-            found = 1;
-            free(accounts[i]);
-            // Shift remaining elements down
-            for (int j = i; j < accountcount - 1; j++)
-                accounts[j] = accounts[j + 1];
-            accountcount--;
-            accounts[accountcount] = NULL; // Clear last (now duplicate) pointer
-            break;
-        }
+        ledger_command cmd = new_command(CMD_DELETE, id);
+        return submit_command(&cmd);
     }
-    if (!found)
-        return 1; // 1 = Not found
-
-    return 0; // 0 = Success
+    int result = apply_delete(id);
+    if (result == 0) flush_logs();
+    return result; // 0 = Success, 1 = Not found
 }
 
 int get_account_details(int id, account* acc_out)
 {
     if (!acc_out) return 1; // Bad output pointer
 
+    pbl_rwlock_rdlock(&accountsLock);
     account *acc = findaccount(id);
     if (acc == NULL)
     {
+        pbl_rwlock_rdunlock(&accountsLock);
         return 1; // 1 = Not found
     }
 
     // Copy data to the output struct
-    memcpy(acc_out, acc, sizeof(account));
+    read_account(acc, acc_out);
+    pbl_rwlock_rdunlock(&accountsLock);
     return 0; // 0 = Success
 }
 
-// For string-building, we use a large static buffer.
-// This is simple, but not thread-safe. Good enough for this project.
-#define MAX_BUFFER_SIZE 16384
-static char g_display_buffer[MAX_BUFFER_SIZE];
+// Backs get_all_accounts_summary() and get_blockchain_string(): one buffer
+// per thread, so concurrent callers on different threads never share one.
+// It grows to fit and is reused by the thread's next call.
+static PBL_THREAD_LOCAL text_buffer threadText = { NULL, 0, 0 };
 
-const char* get_all_accounts_summary()
+int render_accounts_summary(text_buffer* out)
 {
+    int result;
+    pbl_rwlock_rdlock(&accountsLock);
     if (accountcount <= 0)
     {
-        return "No accounts found!\n";
+        result = text_buffer_append(out, "No accounts found!\n", 19);
+    }
+    else
+    {
+        result = text_buffer_printf(out, "\n--- Accounts (%d) ---\n", accountcount);
+        for (uint32_t h = 0; h < slabUsed && result == 0; h++)
+        {
+            account_slot *slot = slotat(h);
+            if (!slot->live) continue;
+            account acc;
+            read_account(&slot->acc, &acc);
+            result = text_buffer_printf(out, "ID: %d, Name: %s, Phone: %s, Balance: $%.2f\n",
+                                        acc.accID, acc.name, acc.phno, acc.balance);
+        }
     }
+    pbl_rwlock_rdunlock(&accountsLock);
+    return result;
+}
 
-    // Clear the buffer
-    g_display_buffer[0] = 0;
+const char* get_all_accounts_summary()
+{
+    text_buffer_clear(&threadText);
+    if (render_accounts_summary(&threadText) != 0) return "Out of memory.\n";
+    return threadText.data;
+}
 
-    char line[256];
-    snprintf(line, sizeof(line), "\n--- Accounts (%d) ---\n", accountcount);
-    strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+// Appends 'text' as a JSON string literal.
+static int render_json_string(text_buffer* out, const char* text)
+{
+    if (text_buffer_append(out, "\"", 1) != 0) return 2;
+    const char* run = text; // start of the stretch that needs no escaping
+    for (const char* p = text; ; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c != 0 && c != '"' && c != '\\' && c >= 0x20) continue;
+        if (text_buffer_append(out, run, (size_t)(p - run)) != 0) return 2;
+        if (c == 0) break;
+        int result = (c == '"' || c == '\\') ? text_buffer_printf(out, "\\%c", c)
+                                             : text_buffer_printf(out, "\\u%04x", c);
+        if (result != 0) return 2;
+        run = p + 1;
+    }
+    return text_buffer_append(out, "\"", 1);
+}
 
-    for (int i = 0; i < accountcount; i++)
-    {
-        snprintf(line, sizeof(line), "ID: %d, Name: %s, Phone: %s, Balance: $%.2f\n",
-               accounts[i]->accID, accounts[i]->name, accounts[i]->phno, accounts[i]->balance);
+#define LIST_BATCH 256 // IDs fetched from accountOrder at a time
 
-        if (strlen(g_display_buffer) + strlen(line) + 1 >= MAX_BUFFER_SIZE) {
-            // Stop if buffer is full
-            strncat(g_display_buffer, "... (buffer full) ...\n", MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
-            break;
+int render_accounts_json(long long* after, int limit, text_buffer* out, long long* count, int* more)
+{
+    int ids[LIST_BATCH];
+    int64_t last = *after;
+    int n = 0;
+    int result = 0;
+    pbl_rwlock_rdlock(&accountsLock);
+    while (n < limit && result == 0) {
+        uint32_t want = limit - n < LIST_BATCH ? (uint32_t)(limit - n) : LIST_BATCH;
+        uint32_t got = ordered_set_next(&accountOrder, last, ids, want);
+        for (uint32_t i = 0; i < got; i++) {
+            account acc;
+            read_account(findaccount(ids[i]), &acc);
+            size_t mark = out->len;
+            if ((*count + n > 0 && text_buffer_append(out, ", ", 2) != 0) ||
+                text_buffer_printf(out, "{\"id\": %d, \"name\": ", acc.accID) != 0 ||
+                render_json_string(out, acc.name) != 0 ||
+                text_buffer_append(out, ", \"phone\": ", 11) != 0 ||
+                render_json_string(out, acc.phno) != 0 ||
+                text_buffer_printf(out, ", \"balance\": %.2f}", acc.balance) != 0) {
+                out->len = mark; // no half objects
+                if (out->data) out->data[mark] = 0;
+                result = 2;
+                break;
+            }
+            last = ids[i];
+            n++;
         }
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+        if (got < want) break;
+    }
+    if (more) {
+        int next;
+        *more = ordered_set_next(&accountOrder, last, &next, 1) > 0;
     }
-    return g_display_buffer;
+    pbl_rwlock_rdunlock(&accountsLock);
+    *after = last;
+    *count += n;
+    return result;
 }
 
 int perform_deposit(int id, float amount)
 {
-    account *acc = findaccount(id);
-    if (acc == NULL)
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Account not found
+        ledger_command cmd = new_command(CMD_DEPOSIT, id);
+        cmd.amount = amount;
+        return submit_command(&cmd);
     }
-    if (amount <= 0)
-    {
-        return 2; // 2 = Invalid amount
+    int64_t ticket = -1;
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_deposit(id, amount, &ticket);
+    pbl_rwlock_rdunlock(&accountsLock);
+
+    if (result == 0) {
+        result = await_sealed(ticket);
+        flush_logs();
     }
-    acc->balance += amount;
-
-    char remark[100];
-    snprintf(remark, sizeof(remark), "Deposit by %s", acc->name);
-    recordTransaction(0, acc->accID, amount, remark);
-
-    return 0; // 0 = Success
+    return result; // 0 = Success
 }
 
 int perform_withdraw(int id, float amount)
 {
-    account *acc = findaccount(id);
-    if (acc == NULL)
+    if (pbl_load64(&sequencerMode))
     {
-        return 1; // 1 = Account not found
+        ledger_command cmd = new_command(CMD_WITHDRAW, id);
+        cmd.amount = amount;
+        return submit_command(&cmd);
     }
-    if (amount <= 0)
+    int64_t ticket = -1;
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_withdraw(id, amount, &ticket);
+    pbl_rwlock_rdunlock(&accountsLock);
+
+    if (result == 0) {
+        result = await_sealed(ticket);
+        flush_logs();
+    }
+    return result; // 0 = Success
+}
+
+int perform_transfer(int fromID, int toID, float amount)
+{
+    if (pbl_load64(&sequencerMode))
     {
-        return 2; // 2 = Invalid amount
+        ledger_command cmd = new_command(CMD_TRANSFER, fromID);
+        cmd.toID = toID;
+        cmd.amount = amount;
+        return submit_command(&cmd);
     }
-    if (amount > acc->balance)
+    int64_t ticket = -1;
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_transfer(fromID, toID, amount, &ticket);
+    pbl_rwlock_rdunlock(&accountsLock);
+
+    if (result == 0) {
+        result = await_sealed(ticket);
+        flush_logs();
+    }
+    return result; // 0 = Success
+}
+
+int perform_batch(batch_op* ops, int count)
+{
+    if (count < 0 || (ops == NULL && count > 0)) return 2; // 2 = Invalid input
+    if (count == 0) return 0;
+
+    if (pbl_load64(&sequencerMode))
     {
-        return 3; // 3 = Insufficient funds
+        ledger_command cmd = new_command(CMD_BATCH, count);
+        cmd.ops = ops;
+        return submit_command(&cmd);
     }
-    acc->balance -= amount;
+    pbl_rwlock_rdlock(&accountsLock);
+    int result = apply_batch(ops, count);
+    pbl_rwlock_rdunlock(&accountsLock);
+    flush_logs();
+    return result; // 0 = Applied (see each op's result)
+}
 
-    char remark[100];
-    snprintf(remark, sizeof(remark), "Withdrawal by %s", acc->name);
-    recordTransaction(acc->accID, 0, amount, remark);
+// Walks the chain without chainLock: blocks are immutable once linked.
+static Block* nextBlock(Block* blk)
+{
+    return (Block*)pbl_load_ptr((void* const volatile*)&blk->next);
+}
 
-    return 0; // 0 = Success
+// The block at 'height', or NULL past the tail. Takes no lock; O(1) unless
+// the index has fallen behind (see BLOCK INDEXES).
+static Block* block_at(int height)
+{
+    if (height < 0) return NULL;
+    int64_t n = pbl_load64(&indexedBlocks);
+    if (height < n) return *(Block**)seg_array_at(&blockIndex, (uint32_t)height);
+    Block* blk = n > 0 ? *(Block**)seg_array_at(&blockIndex, (uint32_t)(n - 1)) : blockchainHead;
+    for (int64_t h = n > 0 ? n - 1 : 0; h < height && blk != NULL; h++)
+        blk = nextBlock(blk);
+    return blk;
 }
 
-int perform_transfer(int fromID, int toID, float amount)
+// The sealed block holding transaction 'txID' and its slot there, or NULL.
+// Takes no lock; O(1) unless the index has fallen behind.
+static Block* find_transaction(int txID, int* slot)
 {
-    account *from = findaccount(fromID);
-    if (from == NULL)
-    {
-        return 1; // 1 = Sender not found
+    if (txID < 1) return NULL;
+    int64_t n = pbl_load64(&indexedTxs);
+    if (txID <= n) {
+        const tx_ref* ref = (const tx_ref*)seg_array_at(&txIndex, (uint32_t)(txID - 1));
+        *slot = (int)ref->slot;
+        return block_at((int)ref->block);
     }
-    account *to = findaccount(toID);
-    if (to == NULL)
-    {
-        return 2; // 2 = Receiver not found
+    // txIDs are handed out in chain order, so a block holds a consecutive run.
+    Block* cur = n > 0 ? block_at((int)((const tx_ref*)seg_array_at(&txIndex, (uint32_t)(n - 1)))->block)
+                       : blockchainHead;
+    for (; cur != NULL; cur = nextBlock(cur)) {
+        if (cur->transactionCount == 0) continue;
+        int first = cur->transactions[0].txID;
+        if (txID < first) break;
+        if (txID <= cur->transactions[cur->transactionCount - 1].txID) {
+            *slot = txID - first;
+            return cur->transactions[*slot].txID == txID ? cur : NULL;
+        }
     }
-    if (amount <= 0 || amount > from->balance)
-    {
-        return 3; // 3 = Invalid amount or insufficient funds
+    return NULL;
+}
+
+int render_blockchain(text_buffer* out)
+{
+    block_cursor cursor;
+    block_cursor_seek(&cursor, 0);
+    int rendered = 0;
+    int result = render_blocks(&cursor, INT_MAX, out, &rendered);
+    if (result == 0 && rendered == 0)
+        result = text_buffer_append(out, "Blockchain is empty.\n", 21);
+    if (result == 0)
+        result = render_pending_transactions(out);
+    return result;
+}
+
+const char* get_blockchain_string()
+{
+    text_buffer_clear(&threadText);
+    if (render_blockchain(&threadText) != 0) return "Out of memory.\n";
+    return threadText.data;
+}
+
+int get_block_count()
+{
+    pbl_mutex_lock(&chainLock);
+    int count = blockCount;
+    pbl_mutex_unlock(&chainLock);
+    return count;
+}
+
+int block_cursor_seek(block_cursor* cursor, int height)
+{
+    if (height < 0) return 2;
+    Block* prev = NULL;
+    if (height > 0) {
+        prev = block_at(height - 1);
+        if (prev == NULL) return 1;
     }
-    from->balance -= amount;
-    to->balance += amount;
+    cursor->prev = prev;
+    cursor->height = height;
+    return 0;
+}
 
-    char remark[100];
-    snprintf(remark, sizeof(remark), "Transfer %d->%d", fromID, toID);
-    recordTransaction(fromID, toID, amount, remark);
+// Appends one block in the get_blockchain_string() format.
+static int render_block(const Block* blk, text_buffer* out)
+{
+    char when[TIMESTAMP_TEXT_LEN];
+    char prevHex[HASH_STR_LEN], rootHex[HASH_STR_LEN], currHex[HASH_STR_LEN];
+    timestamp_format(blk->timestamp, when);
+    hash_to_hex(&blk->previousHash, prevHex);
+    hash_to_hex(&blk->merkleRoot, rootHex);
+    hash_to_hex(&blk->currHash, currHex);
+    if (text_buffer_printf(out, "\n--- Block %d ---\nTimestamp     : %s\nPrevious Hash : %s\n"
+                                "Merkle Root   : %s\nCurrent Hash  : %s\nTransactions (%d):\n",
+                           blk->index, when, prevHex, rootHex, currHex, blk->transactionCount) != 0)
+        return 2;
+    for (int i = 0; i < blk->transactionCount; i++) {
+        const Transaction *t = &blk->transactions[i];
+        timestamp_format(t->timestamp, when);
+        if (text_buffer_printf(out, "  TX %d | %d -> %d | %.2f | %s | %s\n",
+                               t->txID, t->fromAcc, t->toAcc, t->amount, t->remark, when) != 0)
+            return 2;
+    }
+    return 0;
+}
 
-    return 0; // 0 = Success
+int render_blocks(block_cursor* cursor, int maxBlocks, text_buffer* out, int* rendered)
+{
+    Block* prev = (Block*)cursor->prev;
+    Block* blk = prev ? nextBlock(prev) : blockchainHead;
+    int n = 0;
+    int result = 0;
+    for (; n < maxBlocks && blk != NULL; n++) {
+        size_t mark = out->len;
+        if (render_block(blk, out) != 0) {
+            out->len = mark; // no half blocks
+            if (out->data) out->data[mark] = 0;
+            result = 2;
+            break;
+        }
+        prev = blk;
+        blk = nextBlock(blk);
+    }
+    cursor->prev = prev;
+    cursor->height += n;
+    if (rendered) *rendered = n;
+    return result;
 }
 
-const char* get_blockchain_string()
+// Appends one transaction as a JSON object.
+static int render_transaction_json(const Transaction* t, text_buffer* out)
+{
+    char when[TIMESTAMP_TEXT_LEN];
+    timestamp_format(t->timestamp, when);
+    if (text_buffer_printf(out, "{\"txID\": %d, \"from\": %d, \"to\": %d, \"amount\": %.2f, \"remark\": ",
+                           t->txID, t->fromAcc, t->toAcc, t->amount) != 0 ||
+        render_json_string(out, t->remark) != 0)
+        return 2;
+    return text_buffer_printf(out, ", \"timestamp\": \"%s\"}", when);
+}
+
+// Appends one block as a JSON object.
+static int render_block_json(const Block* blk, text_buffer* out)
 {
-    if (blockchainHead == NULL) {
-        return "Blockchain is empty.\n";
+    char when[TIMESTAMP_TEXT_LEN];
+    char prevHex[HASH_STR_LEN], rootHex[HASH_STR_LEN], currHex[HASH_STR_LEN];
+    timestamp_format(blk->timestamp, when);
+    hash_to_hex(&blk->previousHash, prevHex);
+    hash_to_hex(&blk->merkleRoot, rootHex);
+    hash_to_hex(&blk->currHash, currHex);
+    if (text_buffer_printf(out, "{\"index\": %d, \"timestamp\": \"%s\", \"previousHash\": \"%s\", "
+                                "\"merkleRoot\": \"%s\", \"hash\": \"%s\", \"transactions\": [",
+                           blk->index, when, prevHex, rootHex, currHex) != 0)
+        return 2;
+    for (int i = 0; i < blk->transactionCount; i++) {
+        if ((i > 0 && text_buffer_append(out, ", ", 2) != 0) ||
+            render_transaction_json(&blk->transactions[i], out) != 0)
+            return 2;
     }
+    return text_buffer_append(out, "]}", 2);
+}
 
-    g_display_buffer[0] = 0; // Clear buffer
-    char line[512];
+int render_blocks_json(block_cursor* cursor, int maxBlocks, text_buffer* out, long long* count)
+{
+    Block* prev = (Block*)cursor->prev;
+    Block* blk = prev ? nextBlock(prev) : blockchainHead;
+    int n = 0;
+    int result = 0;
+    for (; n < maxBlocks && blk != NULL; n++) {
+        size_t mark = out->len;
+        if ((*count + n > 0 && text_buffer_append(out, ", ", 2) != 0) || render_block_json(blk, out) != 0) {
+            out->len = mark; // no half blocks
+            if (out->data) out->data[mark] = 0;
+            result = 2;
+            break;
+        }
+        prev = blk;
+        blk = nextBlock(blk);
+    }
+    cursor->prev = prev;
+    cursor->height += n;
+    *count += n;
+    return result;
+}
 
-    Block* cur = blockchainHead;
-    while (cur != NULL) {
-        snprintf(line, sizeof(line), "\n--- Block %d ---\n", cur->index);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+int render_transaction(int txID, text_buffer* out, int* block, int* slot)
+{
+    int i = 0;
+    Block* blk = find_transaction(txID, &i);
+    if (blk == NULL) return 1;
+    if (block) *block = blk->index;
+    if (slot) *slot = i;
+    return render_transaction_json(&blk->transactions[i], out);
+}
+
+#define HISTORY_BATCH 256 // txIDs copied out of a history list at a time
 
-        snprintf(line, sizeof(line), "Timestamp     : %s\n", cur->timestamp);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+int render_account_history(int id, long long* before, int limit, text_buffer* out, long long* count, int* more)
+{
+    pbl_rwlock_rdlock(&accountsLock);
+    const account_slot *owner = findslot(id);
+    int historyFrom = owner != NULL ? owner->historyFrom : 0;
+    pbl_rwlock_rdunlock(&accountsLock);
+    if (owner == NULL) return 1;
+
+    int ids[HISTORY_BATCH];
+    int n = 0;
+    int result = 0;
+    int left = 1; // older transactions may remain
+    while (n < limit && left && result == 0) {
+        // Copy a batch out under the lock and render it without.
+        uint32_t want = limit - n < HISTORY_BATCH ? (uint32_t)(limit - n) : HISTORY_BATCH;
+        uint32_t got = 0;
+        uint32_t slot;
+        pbl_rwlock_rdlock(&historyLock);
+        if (historyFailed) {
+            result = 2;
+        } else if (hash_index_find(&historyIndex, id, &slot) == 0) {
+            const posting_list* list = (const posting_list*)seg_array_at(&historyLists, slot);
+            uint32_t first = first_posting(list, historyFrom);
+            uint32_t lo = first_posting(list, *before);
+            uint32_t avail = lo > first ? lo - first : 0;
+            got = avail < want ? avail : want;
+            for (uint32_t k = 0; k < got; k++)
+                ids[k] = list->txIDs[lo - 1 - k];
+            left = avail > got;
+        } else {
+            left = 0;
+        }
+        pbl_rwlock_rdunlock(&historyLock);
+
+        for (uint32_t k = 0; k < got && result == 0; k++) {
+            int i;
+            Block* blk = find_transaction(ids[k], &i);
+            size_t mark = out->len;
+            if (blk != NULL && ((*count + n > 0 && text_buffer_append(out, ", ", 2) != 0) ||
+                                render_transaction_json(&blk->transactions[i], out) != 0)) {
+                out->len = mark; // no half objects
+                if (out->data) out->data[mark] = 0;
+                result = 2;
+                break;
+            }
+            *before = ids[k];
+            if (blk != NULL) n++;
+        }
+    }
+    if (more) *more = left;
+    *count += n;
+    return result;
+}
 
-        snprintf(line, sizeof(line), "Previous Hash : %s\n", cur->previousHash);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+int render_pending_transactions(text_buffer* out)
+{
+    if (pbl_load64(&pendingRingState) != 2) return 0;
+    int64_t want = mpsc_ring_size(&pendingRing);
+    if (want <= 0) return 0;
+    Transaction* copy = (Transaction*)malloc((size_t)want * sizeof(Transaction));
+    if (copy == NULL) return 2;
+
+    // Copy under chainLock, which keeps the sealer from popping while we
+    // peek and fixes the txIDs they will get; render without it. Whatever
+    // is pushed meanwhile shows up next time.
+    int64_t pending = 0;
+    pbl_mutex_lock(&chainLock);
+    int firstTxID = nextTxID;
+    while (pending < want && mpsc_ring_peek(&pendingRing, pending, &copy[pending]) == 0)
+        pending++;
+    pbl_mutex_unlock(&chainLock);
+
+    int result = 0;
+    if (pending > 0) {
+        result = text_buffer_printf(out, "\n--- Pending Transactions (%lld) ---\n", (long long)pending);
+        char when[TIMESTAMP_TEXT_LEN];
+        for (int64_t i = 0; i < pending && result == 0; i++) {
+            const Transaction* t = &copy[i];
+            timestamp_format(t->timestamp, when);
+            result = text_buffer_printf(out, "  (P) TX %lld | %d -> %d | %.2f | %s | %s\n",
+                                        (long long)firstTxID + i, t->fromAcc, t->toAcc, t->amount, t->remark, when);
+        }
+    }
+    free(copy);
+    return result;
+}
 
-        snprintf(line, sizeof(line), "Current Hash  : %s\n", cur->currHash);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+// ---- CHAIN VALIDATION ----
+// A block is bad if its stored hash does not match a recompute of its
+// contents, or if its previousHash does not match the block before it. Each
+// check needs only the block and its predecessor, so the chain is cut into
+// chunks that worker threads claim off a shared counter; the lowest bad
+// index found wins, and chunks past it are skipped.
+//
+// Routine validation is incremental: blocks [0, verifiedCount) passed an
+// earlier run and are immutable, so only blocks appended since then are
+// hashed. The verified prefix is summed up by a rolling digest,
+// D(n) = SHA-256(D(n-1) || hash of block n-1), with a checkpoint every
+// VALIDATE_CHUNK blocks. A full audit re-hashes everything and replays the
+// digest, which also catches a prefix that was rewritten and consistently
+// re-hashed after it was verified.
+
+#define VALIDATE_CHUNK 1024 // blocks a worker claims at a time
+
+static volatile int64_t validationThreads = 0; // 0 = one per CPU
+
+typedef struct chain_check {
+    Block** blocks;                  // the blocks to check, in chain order
+    int64_t count;
+    Block* prev;                     // the block before blocks[0] (NULL for genesis)
+    volatile int64_t nextChunk;      // first block of the next unclaimed chunk
+    volatile int64_t firstBad;       // lowest bad offset so far ('count' if none)
+} chain_check;
+
+// Checks up to SHA256_LANES consecutive blocks, hashing their headers side
+// by side. 'prev' is the block before group[0] (NULL for genesis). Returns
+// the offset of the first bad block in the group, or -1.
+static int check_group(Block* const* group, int n, const Block* prev)
+{
+    unsigned char headers[SHA256_LANES][BLOCK_HEADER_BYTES];
+    const unsigned char* data[SHA256_LANES];
+    size_t len[SHA256_LANES];
+    block_hash digest[SHA256_LANES];
+    if (n <= 0) return -1;
+    for (int i = 0; i < n; i++) {
+        len[i] = encode_block_header(group[i], headers[i]);
+        data[i] = headers[i];
+    }
+    sha256_many(data, len, n, (unsigned char (*)[SHA256_DIGEST_LEN])digest);
 
-        snprintf(line, sizeof(line), "Transactions (%d):\n", cur->transactionCount);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+    for (int i = 0; i < n; i++) {
+        // Recompute and check the block's own hash
+        if (!hash_equal(&digest[i], &group[i]->currHash)) {
+            return i; // Header tampered
+        }
 
-        for (int i = 0; i < cur->transactionCount; i++) {
-            Transaction *t = &cur->transactions[i];
-            snprintf(line, sizeof(line), "  TX %d | %d -> %d | %.2f | %s | %s\n",
-                   t->txID, t->fromAcc, t->toAcc, t->amount, t->remark, t->timestamp);
-            strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+        // The header only commits to the transactions through the root
+        block_hash root;
+        compute_merkle_root(group[i], &root);
+        if (!hash_equal(&root, &group[i]->merkleRoot)) {
+            return i; // Transactions tampered
         }
 
-        if (strlen(g_display_buffer) > MAX_BUFFER_SIZE - 1024) {
-             strncat(g_display_buffer, "... (buffer full) ...\n", MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
-             break; // Stop if buffer is getting full
+        // Check hash linkage
+        const Block* before = i > 0 ? group[i - 1] : prev;
+        if (before != NULL && !hash_equal(&group[i]->previousHash, &before->currHash)) {
+            return i; // Chain broken
         }
-        cur = cur->next;
     }
+    return -1;
+}
 
-    if (pendingCount > 0) {
-        snprintf(line, sizeof(line), "\n--- Pending Transactions (%d) ---\n", pendingCount);
-        strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+static void record_bad_block(chain_check* check, int64_t index)
+{
+    int64_t seen = pbl_load64(&check->firstBad);
+    while (index < seen && !pbl_cas64(&check->firstBad, seen, index))
+        seen = pbl_load64(&check->firstBad);
+}
 
-        for (int i = 0; i < pendingCount; i++) {
-            Transaction *t = &pendingPool[i];
-            snprintf(line, sizeof(line), "  (P) TX %d | %d -> %d | %.2f | %s | %s\n",
-                   t->txID, t->fromAcc, t->toAcc, t->amount, t->remark, t->timestamp);
-            strncat(g_display_buffer, line, MAX_BUFFER_SIZE - strlen(g_display_buffer) - 1);
+static void validate_worker(void* arg)
+{
+    chain_check* check = (chain_check*)arg;
+    for (;;) {
+        int64_t from = pbl_fetch_add64(&check->nextChunk, VALIDATE_CHUNK);
+        if (from >= check->count || from >= pbl_load64(&check->firstBad)) break;
+        int64_t to = from + VALIDATE_CHUNK < check->count ? from + VALIDATE_CHUNK : check->count;
+
+        for (int64_t g = from; g < to; g += SHA256_LANES) {
+            int n = to - g < SHA256_LANES ? (int)(to - g) : SHA256_LANES;
+            int bad = check_group(check->blocks + g, n, g > 0 ? check->blocks[g - 1] : check->prev);
+            if (bad >= 0) {
+                record_bad_block(check, g + bad);
+                break; // later blocks in this chunk cannot be the first bad one
+            }
         }
     }
-    return g_display_buffer;
 }
 
-int perform_validate_chain() {
-    if (blockchainHead == NULL) return 1; // Empty chain is valid
+// Copies the pointers of the blocks after 'after' (the whole chain if NULL)
+// into an array so they can be split up. Returns NULL if memory runs out.
+static Block** snapshot_chain(Block* after, int64_t* count)
+{
+    int64_t n = 0, cap = 1024;
+    Block** blocks = (Block**)malloc(sizeof(Block*) * (size_t)cap);
+    Block* cur = after != NULL ? nextBlock(after) : blockchainHead;
+    for (; cur != NULL && blocks != NULL; cur = nextBlock(cur)) {
+        if (n == cap) {
+            Block** grown = (Block**)realloc(blocks, sizeof(Block*) * (size_t)cap * 2);
+            if (grown == NULL) {
+                free(blocks);
+                return NULL;
+            }
+            blocks = grown;
+            cap *= 2;
+        }
+        blocks[n++] = cur;
+    }
+    *count = n;
+    return blocks;
+}
 
-    Block* cur = blockchainHead;
-    while (cur->next != NULL) {
-        Block* nxt = cur->next;
-        // Check hash linkage
-        if (strcmp(nxt->previousHash, cur->currHash) != 0) {
-            return 0; // Chain broken
+// Runs a chain_check on up to validationThreads threads. Returns the offset
+// of the first bad block, or -1.
+static int64_t run_chain_check(chain_check* check)
+{
+    check->nextChunk = 0;
+    check->firstBad = check->count;
+
+    int64_t threads = pbl_load64(&validationThreads);
+    if (threads == 0) threads = pbl_cpu_count();
+    int64_t chunks = (check->count + VALIDATE_CHUNK - 1) / VALIDATE_CHUNK;
+    if (threads > chunks) threads = chunks;
+
+    // The calling thread is one of the workers; if a thread fails to start,
+    // the ones that did (or the caller alone) take its share.
+    pbl_thread* helpers = NULL;
+    int started = 0;
+    if (threads > 1) helpers = (pbl_thread*)malloc(sizeof(pbl_thread) * (size_t)(threads - 1));
+    if (helpers != NULL) {
+        while (started < threads - 1 && pbl_thread_start(&helpers[started], validate_worker, check) == 0)
+            started++;
+    }
+    validate_worker(check);
+    for (int i = 0; i < started; i++)
+        pbl_thread_join(helpers[i]);
+    free(helpers);
+
+    return check->firstBad < check->count ? check->firstBad : -1;
+}
+
+// Walks the list after 'after' on the calling thread, for when there is no
+// memory for a snapshot. Returns the offset of the first bad block, or -1.
+static int64_t check_chain_serial(Block* after)
+{
+    int64_t result = -1;
+    int64_t base = 0;
+    Block* prev = after;
+    Block* cur = after != NULL ? nextBlock(after) : blockchainHead;
+    while (cur != NULL && result < 0) {
+        Block* group[SHA256_LANES];
+        int n = 0;
+        for (; cur != NULL && n < SHA256_LANES; n++, cur = nextBlock(cur))
+            group[n] = cur;
+        int bad = check_group(group, n, prev);
+        if (bad >= 0) result = base + bad;
+        prev = group[n - 1];
+        base += n;
+    }
+    return result;
+}
+
+// D(n + 1) from D(n) and block n.
+static void roll_digest(block_hash* digest, const Block* blk)
+{
+    unsigned char buf[2 * SHA256_DIGEST_LEN];
+    memcpy(buf, digest->w, SHA256_DIGEST_LEN);
+    memcpy(buf + SHA256_DIGEST_LEN, blk->currHash.w, SHA256_DIGEST_LEN);
+    sha256(buf, sizeof(buf), (unsigned char*)digest->w);
+}
+
+// Extends the verified prefix over 'blocks' (the ones right after it).
+// Caller holds verifyLock. Stops early if a checkpoint cannot be stored.
+static void advance_verified(Block* const* blocks, int64_t n)
+{
+    for (int64_t i = 0; i < n; i++) {
+        block_hash next = verifiedDigest;
+        roll_digest(&next, blocks[i]);
+        if ((verifiedCount + 1) % VALIDATE_CHUNK == 0) {
+            int64_t k = (verifiedCount + 1) / VALIDATE_CHUNK - 1;
+            if (k >= checkpointCap) {
+                int64_t cap = checkpointCap ? checkpointCap * 2 : 64;
+                block_hash* grown = (block_hash*)realloc(verifiedCheckpoints, sizeof(block_hash) * (size_t)cap);
+                if (grown == NULL) return;
+                verifiedCheckpoints = grown;
+                checkpointCap = cap;
+            }
+            verifiedCheckpoints[k] = next;
         }
+        verifiedDigest = next;
+        verifiedTail = blocks[i];
+        verifiedCount++;
+    }
+}
+
+int set_validation_threads(int threads)
+{
+    if (threads < 0) return 2; // 2 = Invalid input
+    pbl_store64(&validationThreads, threads);
+    return 0;
+}
+
+int find_invalid_block()
+{
+    pbl_mutex_lock(&verifyLock);
+    int64_t base = verifiedCount;
+    int64_t bad;
+    chain_check check;
+    check.prev = verifiedTail;
+    check.blocks = snapshot_chain(verifiedTail, &check.count);
+    if (check.blocks == NULL) {
+        bad = check_chain_serial(verifiedTail); // out of memory: check without extending the prefix
+    } else {
+        bad = run_chain_check(&check);
+        // Everything before the first bad block is verified now.
+        advance_verified(check.blocks, bad < 0 ? check.count : bad);
+        free(check.blocks);
+    }
+    pbl_mutex_unlock(&verifyLock);
+    return bad < 0 ? -1 : (int)(base + bad);
+}
 
-        // Recompute and check current block's hash
-        char recomputed[HASH_STR_LEN];
-        compute_hash_for_block(cur, recomputed);
-        if (strcmp(recomputed, cur->currHash) != 0) {
-            return 0; // Data tampered
+int audit_chain()
+{
+    pbl_mutex_lock(&verifyLock);
+    int64_t bad;
+    chain_check check;
+    check.prev = NULL;
+    check.blocks = snapshot_chain(NULL, &check.count);
+    if (check.blocks == NULL) {
+        bad = check_chain_serial(NULL);
+    } else {
+        bad = run_chain_check(&check);
+
+        // Replay the rolling digest over the verified prefix; a mismatch
+        // pins the damage down to one checkpoint interval.
+        int64_t prefix = verifiedCount < check.count ? verifiedCount : check.count;
+        int64_t rewritten = prefix < verifiedCount ? prefix : -1; // blocks went missing
+        block_hash digest;
+        memset(&digest, 0, sizeof(digest));
+        for (int64_t i = 0; i < prefix && rewritten < 0; i++) {
+            roll_digest(&digest, check.blocks[i]);
+            int atCheckpoint = (i + 1) % VALIDATE_CHUNK == 0;
+            if ((atCheckpoint && !hash_equal(&digest, &verifiedCheckpoints[(i + 1) / VALIDATE_CHUNK - 1]))
+                || (i + 1 == verifiedCount && !hash_equal(&digest, &verifiedDigest))) {
+                rewritten = i / VALIDATE_CHUNK * VALIDATE_CHUNK;
+            }
         }
-        cur = cur->next;
+        // A bad block found by hashing inside the same interval is the more precise answer.
+        if (rewritten >= 0 && (bad < 0 || rewritten + VALIDATE_CHUNK <= bad)) bad = rewritten;
+
+        if (bad < 0) advance_verified(check.blocks + verifiedCount, check.count - verifiedCount);
+        free(check.blocks);
     }
+    pbl_mutex_unlock(&verifyLock);
+    return bad < 0 ? -1 : (int)bad;
+}
+
+int get_verified_block_count()
+{
+    pbl_mutex_lock(&verifyLock);
+    int64_t count = verifiedCount;
+    pbl_mutex_unlock(&verifyLock);
+    return (int)count;
+}
+
+int perform_validate_chain() {
+    return find_invalid_block() < 0 ? 1 : 0; // 1 = Valid
+}
 
-    // Check the last block's hash
-    char recomputedLast[HASH_STR_LEN];
-    compute_hash_for_block(cur, recomputedLast);
-    if (strcmp(recomputedLast, cur->currHash) != 0) {
-        return 0; // Last block tampered
+int get_transaction_proof(int txID, tx_proof* proof)
+{
+    int leafIndex = -1;
+    Block* blk = find_transaction(txID, &leafIndex);
+    if (blk == NULL) return 1; // 1 = Not found
+
+    int count = blk->transactionCount;
+    block_hash* level = (block_hash*)malloc(sizeof(block_hash) * (size_t)count);
+    if (level == NULL) return 4; // 4 = Out of memory
+    for (int from = 0; from < count; from += SHA256_LANES)
+        hash_leaves(blk, from, count - from < SHA256_LANES ? count - from : SHA256_LANES, level + from);
+
+    const Transaction* t = &blk->transactions[leafIndex];
+    proof->txID = txID;
+    proof->fromAcc = t->fromAcc;
+    proof->toAcc = t->toAcc;
+    proof->amount = t->amount;
+    proof->blockIndex = blk->index;
+    proof->leafIndex = leafIndex;
+    proof->leafCount = count;
+    proof->leafData[0] = 0x00;
+    proof->leafDataLen = 1 + (int)encode_transaction(t, proof->leafData + 1);
+    memcpy(proof->leaf, level[leafIndex].w, PROOF_HASH_LEN);
+
+    // Climb level by level, collecting the sibling at each one (a node
+    // carried up without a partner has none).
+    int node = leafIndex;
+    proof->steps = 0;
+    while (count > 1) {
+        if ((node ^ 1) < count) {
+            memcpy(proof->siblings[proof->steps], level[node ^ 1].w, PROOF_HASH_LEN);
+            proof->siblingOnLeft[proof->steps] = (unsigned char)(node & 1);
+            proof->steps++;
+        }
+        int parents = 0;
+        for (int i = 0; i + 1 < count; i += 2)
+            merkle_node(&level[i], &level[i + 1], &level[parents++]);
+        if (count & 1) level[parents++] = level[count - 1];
+        count = parents;
+        node >>= 1;
     }
+    free(level);
 
-    return 1; // 1 = Valid
-}
\ No newline at end of file
+    memcpy(proof->merkleRoot, blk->merkleRoot.w, PROOF_HASH_LEN);
+    encode_block_header(blk, proof->header);
+    memcpy(proof->blockHash, blk->currHash.w, PROOF_HASH_LEN);
+    return 0;
+}
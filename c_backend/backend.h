@@ -3,6 +3,10 @@
 #ifndef PBL_BACKEND_H
 #define PBL_BACKEND_H
 
+#include <stddef.h>
+
+#include "text_buffer.h"
+
 // ------------------------------------------- STRUCTURES -------------------------------------------------------
 // We expose the 'account' struct so the GUI can request details.
 typedef struct account
@@ -13,6 +17,71 @@ typedef struct account
     float balance;
 } account;
 
+// One operation for perform_batch().
+#define BATCH_DEPOSIT 1
+#define BATCH_WITHDRAW 2
+#define BATCH_TRANSFER 3
+
+typedef struct batch_op
+{
+    int type;     // BATCH_DEPOSIT, BATCH_WITHDRAW or BATCH_TRANSFER
+    int id;       // the account (the sender, for a transfer)
+    int toID;     // the receiver (transfers only)
+    float amount;
+    int result;   // set by perform_batch(): what the single call would have returned
+} batch_op;
+
+// A Merkle inclusion proof for one sealed transaction (get_transaction_proof()).
+// To check it: hash leafData to get 'leaf'; fold in each sibling, taking
+// SHA-256(0x01 || sibling || node) when siblingOnLeft[i] and
+// SHA-256(0x01 || node || sibling) otherwise, which must give merkleRoot;
+// 'header' contains merkleRoot (bytes 48-79) and hashes to blockHash.
+#define PROOF_HASH_LEN 32
+#define PROOF_MAX_STEPS 32
+#define PROOF_HEADER_LEN 80
+#define PROOF_LEAF_MAX 128
+
+typedef struct tx_proof
+{
+    int txID;
+    int fromAcc;
+    int toAcc;
+    float amount;
+    int blockIndex;
+    int leafIndex;   // position of the transaction in its block
+    int leafCount;   // transactions in the block
+    int leafDataLen;
+    unsigned char leafData[PROOF_LEAF_MAX];    // 0x00 followed by the transaction's encoding
+    unsigned char leaf[PROOF_HASH_LEN];        // SHA-256 of leafData
+    int steps;
+    unsigned char siblings[PROOF_MAX_STEPS][PROOF_HASH_LEN];
+    unsigned char siblingOnLeft[PROOF_MAX_STEPS];
+    unsigned char merkleRoot[PROOF_HASH_LEN];
+    unsigned char header[PROOF_HEADER_LEN];    // the block header's encoding
+    unsigned char blockHash[PROOF_HASH_LEN];
+} tx_proof;
+
+// Background snapshot figures (get_snapshot_stats()).
+typedef struct snapshot_stats
+{
+    int running;               // 1 while a snapshot is being taken
+    long long snapshots;       // completed since startup
+    long long failures;
+    long long lastMs;          // the last completed one: fork to child exit
+    long long lastPauseMs;     // how long it kept writers out (mostly the fork itself)
+    long long lastCowPages;    // pages the child ended up with a private copy of (-1 = unknown)
+    long long lastCowBytes;
+} snapshot_stats;
+
+// A position in the chain for render_blocks(): just after block height - 1.
+// Blocks never move or go away while the system runs, so a cursor stays
+// valid between calls (and keeps working as blocks are appended).
+typedef struct block_cursor
+{
+    void* prev; // the block before the cursor (NULL at the start of the chain)
+    int height; // the height of the next block
+} block_cursor;
+
 
 // This 'extern "C"' block is ESSENTIAL.
 // It tells the C++ compiler to treat these as C functions,
@@ -25,19 +94,176 @@ extern "C" {
 
 /**
  * @brief Initializes the backend system.
- * Loads users, loads accounts, and creates the genesis block.
+ * Loads users and accounts (the accounts.dat / users.dat snapshots plus
+ * the state log, state.wal), rebuilds the chain from the ledger log
+ * (ledger.log), creating the genesis block on the first run, and starts
+ * the background checkpointer.
  * Must be called once when the GUI application starts.
  */
 void initialize_system();
 
 /**
  * @brief Shuts down the backend system.
- * Saves all data to files and frees memory.
+ * Checkpoints all data to files (leaving the state log empty) and frees memory.
  * Must be called once when the GUI application exits.
  */
 void shutdown_system();
 
 
+// --- Ledger Functions ---
+
+/**
+ * @brief Sets when pending transactions are sealed into a block. A block is
+ * sealed once maxTransactions are pending, once the oldest pending one has
+ * waited maxDelayMs, or once it holds maxBytes of transactions, whichever
+ * comes first. The default (1, 0, 0) seals every transaction on its own.
+ * A batch (perform_batch()) is only split by maxBytes.
+ * A deposit, withdrawal or transfer returns only once its transaction is
+ * sealed, so with maxDelayMs set a caller may wait up to that long for its
+ * block; without it, a caller whose block is not full seals whatever is
+ * pending itself.
+ * Not thread-safe against itself; call it from one thread at a time.
+ * @param maxTransactions Transactions per block (at least 1).
+ * @param maxDelayMs Longest a transaction waits to be sealed, or 0 for no time limit.
+ * @param maxBytes Transaction bytes per block, or 0 for no limit.
+ * @return 0 on success.
+ * @return 2 if an argument is invalid or the seal timer cannot be started.
+ */
+int set_block_policy(int maxTransactions, long maxDelayMs, size_t maxBytes);
+
+// Durability of sealed blocks (set_ledger_sync()).
+#define LEDGER_SYNC_WRITE 1 // written to the OS: survives a crash of the process
+#define LEDGER_SYNC_FULL 2  // written and fdatasync'ed: survives a power loss (the default)
+
+/**
+ * @brief Sets how far a sealed block must reach before the deposit, withdrawal,
+ * transfer or batch that sealed it returns. Concurrent callers share one
+ * write (and sync) of the ledger log, so its cost is paid per group of
+ * blocks, not per transaction. Account and user changes
+ * reach the state log the same way before their calls return.
+ * Call before initialize_system().
+ * @param mode LEDGER_SYNC_WRITE or LEDGER_SYNC_FULL.
+ * @return 0 on success, 2 if the mode is invalid.
+ */
+int set_ledger_sync(int mode);
+
+/**
+ * @brief Reports on the ledger log.
+ * @param[out] blocks Blocks in the log (replayed at startup or appended since); may be NULL.
+ * @param[out] flushes Group commits (one write + sync each) since startup; may be NULL.
+ * @param[out] droppedBytes Bytes of a torn last record cut off the end at startup; may be NULL.
+ * @return 0 on success, 1 if the log is not open (it could not be opened, or
+ * initialize_system() has not run), 3 if ledger.log is corrupt before its
+ * end. It is then left untouched and the chain holds only the blocks before
+ * the damage, so the caller should not carry on.
+ */
+int get_ledger_log_stats(long long* blocks, long long* flushes, long long* droppedBytes);
+
+
+// --- Persistence Functions ---
+
+/**
+ * @brief Sets when the background checkpointer brings accounts.dat /
+ * users.dat up to date and drops the state log records they cover: every
+ * intervalMs if anything changed, or as soon as the log reaches maxLogBytes.
+ * A checkpoint never blocks balance changes; creates and deletes wait at
+ * most for one chunk of accounts to be copied. The default is (60000, 64 MB).
+ * @param intervalMs Time between checkpoints, or 0 for no time trigger.
+ * @param maxLogBytes State log size that triggers one, or 0 for no size trigger.
+ * @return 0 on success, 2 if an argument is invalid.
+ */
+int set_checkpoint_policy(long intervalMs, size_t maxLogBytes);
+
+/**
+ * @brief Checkpoints now, on the calling thread.
+ * @return 0 on success, 2 if a snapshot could not be written.
+ */
+int perform_checkpoint();
+
+/**
+ * @brief Reports on the state log and checkpoints.
+ * @param[out] logBytes Bytes in the state log (changes since the last checkpoint); may be NULL.
+ * @param[out] checkpoints Checkpoints completed since startup; may be NULL.
+ * @param[out] lastMs How long the last one took, in milliseconds; may be NULL.
+ * @return 0 on success, 1 if the state log is not open, 3 if state.wal (or
+ * state.wal.old) is corrupt before its end. It is then left untouched and
+ * only the changes before the damage were applied, so the caller should
+ * not carry on.
+ */
+int get_checkpoint_stats(long long* logBytes, long long* checkpoints, long long* lastMs);
+
+/**
+ * @brief Sets how often a background snapshot is taken: a forked child
+ * writes accounts, users and the chain as of one instant to
+ * accounts.dat.snap, users.dat.snap and ledger.log.snap (a complete data
+ * directory to restore from, without state.wal) while the server goes on
+ * serving. Not available on Windows.
+ * @param intervalMs Time between snapshots, or 0 for on request only (the default).
+ * @return 0 on success, 2 if intervalMs is negative.
+ */
+int set_snapshot_interval(long intervalMs);
+
+/**
+ * @brief Asks the background snapshotter for a snapshot now and returns at once.
+ * @return 0 if it was started, 1 if one is already under way, 2 if
+ * snapshots are unavailable (Windows, or the system is not initialized).
+ */
+int start_snapshot();
+
+/**
+ * @brief Reports on background snapshots.
+ * @return 0 on success, 1 if snapshots are unavailable.
+ */
+int get_snapshot_stats(snapshot_stats* out);
+
+
+// --- Capacity Functions ---
+
+/**
+ * @brief Caps the memory used by the account and user tables, their indexes
+ * and the pending transaction pool. Ledger blocks are not counted.
+ * Once the budget is reached, creates/registers fail with "limit reached".
+ * @param bytes The budget in bytes, or 0 for no limit (the default).
+ */
+void set_memory_budget(size_t bytes);
+
+/**
+ * @brief Returns the bytes currently counted against the memory budget.
+ */
+size_t get_memory_usage();
+
+/**
+ * @brief Pre-allocates room for the given number of accounts and users,
+ * so a node can be sized ahead of time and never grows under load.
+ * @return 0 on success.
+ * @return 1 if the reservation would exceed the memory budget.
+ * @return 2 if memory allocation fails.
+ */
+int reserve_capacity(long accounts, long users);
+
+
+// --- Concurrency Mode ---
+
+/**
+ * @brief Switches to single-writer mode. Every account mutation (create,
+ * update, delete, deposit, withdraw, transfer) becomes a command that
+ * callers publish into a lock-free ring; one sequencer thread applies them
+ * in order and seals the ledger, and the caller blocks until its command is done.
+ * Ledger order is then exactly the order commands entered the ring.
+ * Call after initialize_system() and before other threads use the backend.
+ * @param cpu The CPU to pin the sequencer thread to, or -1 to leave it unpinned.
+ * @return 0 on success (or if already running), 2 if the thread or ring cannot be allocated.
+ */
+int start_sequencer(int cpu);
+
+/**
+ * @brief Applies every command already queued, stops the sequencer thread
+ * and returns to per-account locking. No other thread may be calling into
+ * the backend. shutdown_system() calls this itself.
+ */
+void stop_sequencer();
+
+
 // --- Auth Functions ---
 
 /**
@@ -55,7 +281,9 @@ int perform_login(int accid, const char* username, const char* password);
  * @param username The new user's username.
  * @param password The new user's password.
  * @return 0 on success.
- * @return 1 if user limit is reached.
+ * @return 1 if the memory budget is reached.
+ * @return 2 if input is invalid or memory allocation fails.
+ * @return 3 if a user with this ID already exists.
  */
 int perform_register(int id, const char* username, const char* password);
 
@@ -69,7 +297,7 @@ int perform_register(int id, const char* username, const char* password);
  * @param phno The account holder's phone number.
  * @param balance The initial balance.
  * @return 0 on success.
- * @return 1 if account limit is reached.
+ * @return 1 if the memory budget is reached.
  * @return 2 if memory allocation fails.
  * @return 3 if an account with this ID already exists.
  */
@@ -115,13 +343,35 @@ int perform_delete_account(int id);
  */
 int get_account_details(int id, account* acc_out);
 
+/**
+ * @brief Appends a formatted list of all accounts to a caller-owned buffer.
+ * Safe to call from any number of threads at once.
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int render_accounts_summary(text_buffer* out);
+
 /**
  * @brief Returns a formatted string containing all account details.
  * The GUI can display this in a text area.
- * @return A pointer to a static string. Do not free this pointer.
+ * @return render_accounts_summary() output in a buffer owned by the calling
+ * thread, valid until that thread's next call here or to
+ * get_blockchain_string(). Do not free this pointer.
  */
 const char* get_all_accounts_summary();
 
+/**
+ * @brief Appends up to 'limit' accounts with IDs above *after to 'out' as
+ * JSON objects, in ascending ID order, and moves *after to the last one.
+ * Objects are separated by ", "; one is put in front of the first as well
+ * when *count is not 0, so a listing can be built up over several calls.
+ * Costs O(log accounts + accounts appended).
+ * @param[in,out] count Incremented by the number of accounts appended.
+ * @param[out] more Set to 1 if accounts with higher IDs remain, else 0; may be NULL.
+ * @return 0 on success, 2 if memory allocation fails (*after and *count then
+ * cover the accounts that did fit).
+ */
+int render_accounts_json(long long* after, int limit, text_buffer* out, long long* count, int* more);
+
 
 // --- Banking (Transaction) Functions ---
 
@@ -133,6 +383,9 @@ const char* get_all_accounts_summary();
  * @return 0 on success.
  * @return 1 if account not found.
  * @return 2 if amount is invalid (<= 0).
+ * @return 4 if the ledger cannot record or seal the transaction (out of
+ * memory). If only sealing failed, the balance change stands and the
+ * transaction stays pending until a later seal.
  */
 int perform_deposit(int id, float amount);
 
@@ -145,6 +398,9 @@ int perform_deposit(int id, float amount);
  * @return 1 if account not found.
  * @return 2 if amount is invalid (<= 0).
  * @return 3 if funds are insufficient.
+ * @return 4 if the ledger cannot record or seal the transaction (out of
+ * memory). If only sealing failed, the balance change stands and the
+ * transaction stays pending until a later seal.
  */
 int perform_withdraw(int id, float amount);
 
@@ -158,25 +414,164 @@ int perform_withdraw(int id, float amount);
  * @return 1 if sender not found.
  * @return 2 if receiver not found.
  * @return 3 if amount is invalid or funds are insufficient.
+ * @return 4 if the ledger cannot record or seal the transaction (out of
+ * memory). If only sealing failed, the balance change stands and the
+ * transaction stays pending until a later seal.
  */
 int perform_transfer(int fromID, int toID, float amount);
 
+/**
+ * @brief Applies many deposits, withdrawals and transfers in one call.
+ * Operations run in order (a later one sees the balances left by earlier
+ * ones) under a single acquisition of the locks they need (or a single
+ * sequencer command). The successful ones are sealed together, right after
+ * whatever was already pending, in as few blocks as the block byte cap
+ * (set_block_policy()'s maxBytes) allows: one block when there is no cap.
+ * The per-block transaction count does not split a batch. Each op's
+ * 'result' gets the code perform_deposit(), perform_withdraw() or
+ * perform_transfer() would have returned, or 5 for an unknown type.
+ * @param ops The operations; their 'result' fields are filled in.
+ * @param count The number of operations.
+ * @return 0 if the batch was applied (check each op's result).
+ * @return 2 if the arguments are invalid.
+ * @return 4 if the ledger cannot record the batch (out of memory); nothing was applied.
+ */
+int perform_batch(batch_op* ops, int count);
+
 
 // --- Blockchain Functions ---
 
+/**
+ * @brief Appends every block, then any pending transactions, to a
+ * caller-owned buffer. Safe to call from any number of threads at once.
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int render_blockchain(text_buffer* out);
+
 /**
  * @brief Returns a formatted string of the entire blockchain.
  * The GUI can display this in a text area.
- * @return A pointer to a static string. Do not free this pointer.
+ * @return render_blockchain() output in a buffer owned by the calling
+ * thread, valid until that thread's next call here or to
+ * get_all_accounts_summary(). Do not free this pointer.
  */
 const char* get_blockchain_string();
 
+/**
+ * @brief Number of blocks in the chain (sealed ones; genesis included).
+ */
+int get_block_count();
+
+/**
+ * @brief Points a cursor at block 'height' (0 = genesis; blockCount = just
+ * past the tail). Takes constant time: blocks are indexed by height.
+ * @return 0 on success, 1 if the chain is shorter than 'height', 2 if height is negative.
+ */
+int block_cursor_seek(block_cursor* cursor, int height);
+
+/**
+ * @brief Appends up to maxBlocks blocks from the cursor to 'out', in the
+ * get_blockchain_string() format, and moves the cursor past them. Costs
+ * O(text appended); takes no locks, so it never holds up sealing.
+ * @param[out] rendered How many blocks were appended (0 at the end of the chain); may be NULL.
+ * @return 0 on success, 2 if memory allocation fails (the cursor is then
+ * past the blocks that did fit).
+ */
+int render_blocks(block_cursor* cursor, int maxBlocks, text_buffer* out, int* rendered);
+
+/**
+ * @brief render_blocks() in JSON: each block is an object with its hashes in
+ * hex and its transactions as an array. Objects are separated by ", "; one
+ * is put in front of the first as well when *count is not 0.
+ * @param[in,out] count Incremented by the number of blocks appended.
+ * @return 0 on success, 2 if memory allocation fails (the cursor is then
+ * past the blocks that did fit).
+ */
+int render_blocks_json(block_cursor* cursor, int maxBlocks, text_buffer* out, long long* count);
+
+/**
+ * @brief Appends sealed transaction 'txID' to 'out' as a JSON object (the
+ * same form as in render_blocks_json()). Constant time: txIDs are indexed.
+ * @param[out] block The height of the block holding it; may be NULL.
+ * @param[out] slot Its position in that block; may be NULL.
+ * @return 0 on success, 1 if no such transaction is sealed, 2 if memory allocation fails.
+ */
+int render_transaction(int txID, text_buffer* out, int* block, int* slot);
+
+/**
+ * @brief Appends up to 'limit' of account 'id''s sealed transactions with
+ * txIDs below *before to 'out', newest first, as JSON objects (the same form
+ * as in render_blocks_json()), and moves *before to the last one appended.
+ * Pass LLONG_MAX for the newest page. Objects are separated by ", "; one is
+ * put in front of the first as well when *count is not 0. Each account's
+ * transactions are indexed as they are sealed, so a page costs
+ * O(log history + page), whatever its position. The statement starts when
+ * the account was created: an earlier, deleted account with the same ID
+ * contributes nothing, and deleted accounts have no statement (their
+ * transactions are still served by render_transaction()).
+ * @param[in,out] count Incremented by the number of transactions appended.
+ * @param[out] more Set to 1 if older transactions remain, else 0; may be NULL.
+ * @return 0 on success, 1 if there is no such account, 2 if memory
+ * allocation fails now or failed earlier while indexing (*before and *count
+ * then cover what did fit).
+ */
+int render_account_history(int id, long long* before, int limit, text_buffer* out, long long* count, int* more);
+
+/**
+ * @brief Appends the transactions waiting to be sealed (nothing if there are
+ * none), with the txIDs they will get. A read only: it holds the chain lock
+ * just long enough to copy them and never seals.
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int render_pending_transactions(text_buffer* out);
+
 /**
  * @brief Validates the integrity of the blockchain.
  * @return 1 if the chain is valid, 0 if it is broken.
  */
 int perform_validate_chain();
 
+/**
+ * @brief Validates the blockchain on several threads and reports where it breaks.
+ * A block is bad if its contents do not match its hash or its previous hash
+ * does not match the block before it. Blocks that passed an earlier call are
+ * not checked again, so routine calls only cost the blocks added since.
+ * @return The index of the first bad block, or -1 if the chain is valid.
+ */
+int find_invalid_block();
+
+/**
+ * @brief Full audit: re-checks every block from genesis, and checks that the
+ * blocks verified earlier are still the ones that were verified (even if
+ * they were rewritten and consistently re-hashed).
+ * @return The index of the first bad block, or -1 if the chain is valid. A
+ * rewritten block is reported as the first block of its 1024-block interval.
+ */
+int audit_chain();
+
+/**
+ * @brief Number of blocks, from genesis on, that have passed validation.
+ */
+int get_verified_block_count();
+
+/**
+ * @brief Builds a Merkle inclusion proof for a sealed transaction, so it can be
+ * checked against the block hash without the rest of the block.
+ * @param txID The transaction to prove.
+ * @param[out] proof Receives the proof (see tx_proof).
+ * @return 0 on success.
+ * @return 1 if no sealed transaction has that ID (it may still be pending).
+ * @return 4 if memory allocation fails.
+ */
+int get_transaction_proof(int txID, tx_proof* proof);
+
+/**
+ * @brief Sets how many threads find_invalid_block() and audit_chain() may use.
+ * @param threads The thread count, or 0 for one per CPU (the default).
+ * @return 0 on success, 2 if the count is negative.
+ */
+int set_validation_threads(int threads);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+
+#include "hash_index.h"
+
+#define HASH_INDEX_MIN_CAPACITY 16
+#define SLOT_FREE 0 // entries store value + 1, so an all-zero entry is free
+
+// Grow once the table is 70% full; linear probing degrades quickly past that.
+#define HASH_INDEX_NEEDS_GROW(count, cap) ((uint64_t)(count) * 10 >= (uint64_t)(cap) * 7)
+
+// Old slots examined per insert/remove while a grow is in progress. The new
+// table is twice as large, so it cannot fill up before the old one is drained.
+#define HASH_INDEX_MIGRATE_STEP 16
+
+// ------------------------------------------- (INTERNAL) HELPER FUNCTIONS ----------------------------------------
+
+// murmur3 finalizer: sequential account IDs spread evenly over the table.
+static uint32_t mix_key(int key)
+{
+    uint32_t h = (uint32_t)key;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Zeroed memory is an empty table. calloc hands large tables back as fresh
+// zero pages, so allocating the next table costs no up-front memset.
+static hash_index_entry* alloc_slots(uint32_t capacity)
+{
+    return (hash_index_entry*)calloc(capacity, sizeof(hash_index_entry));
+}
+
+static void place_entry(hash_index_entry* slots, uint32_t mask, int key, uint32_t value)
+{
+    uint32_t pos = mix_key(key) & mask;
+    while (slots[pos].stored != SLOT_FREE)
+        pos = (pos + 1) & mask;
+    slots[pos].key = key;
+    slots[pos].stored = value + 1;
+}
+
+// Returns the slot holding 'key' in 'slots', or -1.
+static long find_in(const hash_index_entry* slots, uint32_t capacity, int key)
+{
+    if (capacity == 0) return -1;
+    uint32_t mask = capacity - 1;
+    uint32_t pos = mix_key(key) & mask;
+    while (slots[pos].stored != SLOT_FREE) {
+        if (slots[pos].key == key) return (long)pos;
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+// Backward-shift deletion: pull later members of the probe chain into the
+// hole so lookups never need tombstones.
+static void remove_at(hash_index_entry* slots, uint32_t capacity, uint32_t hole)
+{
+    uint32_t mask = capacity - 1;
+    uint32_t pos = (hole + 1) & mask;
+    while (slots[pos].stored != SLOT_FREE) {
+        uint32_t home = mix_key(slots[pos].key) & mask;
+        // Move the entry if its home slot is not in the (cyclic) range (hole, pos].
+        if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+            slots[hole] = slots[pos];
+            hole = pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    slots[hole].stored = SLOT_FREE;
+}
+
+// Moves up to 'steps' old slots into the new table; frees the old table when drained.
+static void migrate(hash_index* idx, uint32_t steps)
+{
+    while (idx->old_slots != NULL && steps-- > 0) {
+        if (idx->old_count == 0 || idx->migrate_pos >= idx->old_capacity) {
+            free(idx->old_slots);
+            idx->old_slots = NULL;
+            idx->old_capacity = 0;
+            idx->old_count = 0;
+            idx->migrate_pos = 0;
+            return;
+        }
+        hash_index_entry* e = &idx->old_slots[idx->migrate_pos];
+        if (e->stored == SLOT_FREE) {
+            idx->migrate_pos++;
+            continue;
+        }
+        place_entry(idx->slots, idx->capacity - 1, e->key, e->stored - 1);
+        // The backward shift may pull another entry into this slot, so look
+        // at the same position again next step.
+        remove_at(idx->old_slots, idx->old_capacity, idx->migrate_pos);
+        idx->old_count--;
+    }
+}
+
+static int start_grow(hash_index* idx)
+{
+    // A grow can only start once the previous one has finished.
+    migrate(idx, 0xFFFFFFFFu);
+
+    uint32_t newcap = idx->capacity ? idx->capacity * 2 : HASH_INDEX_MIN_CAPACITY;
+    hash_index_entry* slots = alloc_slots(newcap);
+    if (slots == NULL) return 1;
+
+    if (idx->count == 0) {
+        free(idx->slots);
+    } else {
+        idx->old_slots = idx->slots;
+        idx->old_capacity = idx->capacity;
+        idx->old_count = idx->count;
+        idx->migrate_pos = 0;
+    }
+    idx->slots = slots;
+    idx->capacity = newcap;
+    return 0;
+}
+
+// Capacity hash_index_reserve() would settle on for 'count' keys (0 = too large).
+static uint32_t reserve_capacity_for(const hash_index* idx, uint32_t count)
+{
+    uint32_t newcap = idx->capacity ? idx->capacity : HASH_INDEX_MIN_CAPACITY;
+    while (HASH_INDEX_NEEDS_GROW(count, newcap)) {
+        if (newcap >= 0x80000000u) return 0;
+        newcap *= 2;
+    }
+    return newcap;
+}
+
+// ------------------------------------------- PUBLIC API FUNCTIONS -----------------------------------------------
+
+void hash_index_init(hash_index* idx)
+{
+    idx->slots = NULL;
+    idx->capacity = 0;
+    idx->count = 0;
+    idx->old_slots = NULL;
+    idx->old_capacity = 0;
+    idx->old_count = 0;
+    idx->migrate_pos = 0;
+}
+
+void hash_index_free(hash_index* idx)
+{
+    free(idx->slots);
+    free(idx->old_slots);
+    hash_index_init(idx);
+}
+
+int hash_index_find(const hash_index* idx, int key, uint32_t* value_out)
+{
+    long pos = find_in(idx->slots, idx->capacity, key);
+    if (pos >= 0) {
+        if (value_out) *value_out = idx->slots[pos].stored - 1;
+        return 0;
+    }
+    if (idx->old_slots != NULL) {
+        pos = find_in(idx->old_slots, idx->old_capacity, key);
+        if (pos >= 0) {
+            if (value_out) *value_out = idx->old_slots[pos].stored - 1;
+            return 0;
+        }
+    }
+    return 1; // 1 = Not found
+}
+
+int hash_index_insert(hash_index* idx, int key, uint32_t value)
+{
+    if (hash_index_find(idx, key, NULL) == 0) return 1; // 1 = Key already exists
+
+    uint32_t in_new = idx->count - idx->old_count;
+    if (idx->capacity == 0 || HASH_INDEX_NEEDS_GROW(in_new + 1, idx->capacity)) {
+        if (start_grow(idx) != 0) return 2; // 2 = Memory allocation failed
+    }
+    place_entry(idx->slots, idx->capacity - 1, key, value);
+    idx->count++;
+    migrate(idx, HASH_INDEX_MIGRATE_STEP);
+    return 0;
+}
+
+int hash_index_update(hash_index* idx, int key, uint32_t value)
+{
+    long pos = find_in(idx->slots, idx->capacity, key);
+    if (pos >= 0) {
+        idx->slots[pos].stored = value + 1;
+        return 0;
+    }
+    if (idx->old_slots != NULL) {
+        pos = find_in(idx->old_slots, idx->old_capacity, key);
+        if (pos >= 0) {
+            idx->old_slots[pos].stored = value + 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int hash_index_remove(hash_index* idx, int key)
+{
+    long pos = find_in(idx->slots, idx->capacity, key);
+    if (pos >= 0) {
+        remove_at(idx->slots, idx->capacity, (uint32_t)pos);
+    } else {
+        if (idx->old_slots == NULL) return 1;
+        pos = find_in(idx->old_slots, idx->old_capacity, key);
+        if (pos < 0) return 1;
+        remove_at(idx->old_slots, idx->old_capacity, (uint32_t)pos);
+        idx->old_count--;
+    }
+    idx->count--;
+    migrate(idx, HASH_INDEX_MIGRATE_STEP);
+    return 0;
+}
+
+int hash_index_reserve(hash_index* idx, uint32_t count)
+{
+    migrate(idx, 0xFFFFFFFFu);
+
+    uint32_t newcap = reserve_capacity_for(idx, count);
+    if (newcap == 0) return 2;
+    if (newcap == idx->capacity) return 0;
+
+    // Done up front when sizing a node, so a one-off full rehash is fine here.
+    hash_index_entry* slots = alloc_slots(newcap);
+    if (slots == NULL) return 2;
+    for (uint32_t i = 0; i < idx->capacity; i++) {
+        if (idx->slots[i].stored != SLOT_FREE)
+            place_entry(slots, newcap - 1, idx->slots[i].key, idx->slots[i].stored - 1);
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->capacity = newcap;
+    return 0;
+}
+
+size_t hash_index_reserve_cost(const hash_index* idx, uint32_t count)
+{
+    uint32_t newcap = reserve_capacity_for(idx, count);
+    if (newcap <= idx->capacity) return 0;
+    return (size_t)newcap * sizeof(hash_index_entry);
+}
+
+size_t hash_index_memory_usage(const hash_index* idx)
+{
+    return ((size_t)idx->capacity + idx->old_capacity) * sizeof(hash_index_entry);
+}
+
+size_t hash_index_insert_cost(const hash_index* idx)
+{
+    uint32_t in_new = idx->count - idx->old_count;
+    if (idx->capacity != 0 && !HASH_INDEX_NEEDS_GROW(in_new + 1, idx->capacity)) return 0;
+    size_t newcap = idx->capacity ? (size_t)idx->capacity * 2 : HASH_INDEX_MIN_CAPACITY;
+    return newcap * sizeof(hash_index_entry);
+}
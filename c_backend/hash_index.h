@@ -0,0 +1,103 @@
+#ifndef PBL_HASH_INDEX_H
+#define PBL_HASH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------------------------- HASH INDEX -------------------------------------------------------
+// Open-addressing (linear probing) hash table mapping an int key (account ID,
+// user ID, ...) to a 32-bit slot handle. Deletes use backward-shift, so there
+// are no tombstones and probe chains stay short no matter how many deletes
+// have happened.
+//
+// Growth is incremental: when the table fills up a table twice the size is
+// allocated and every following insert/remove migrates a few old slots into
+// it. Lookups check both tables while a migration is running, so no single
+// insert ever pays for rehashing millions of keys.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The one value that cannot be stored.
+#define HASH_INDEX_EMPTY 0xFFFFFFFFu
+
+typedef struct hash_index_entry {
+    int key;
+    uint32_t stored; // value + 1; 0 marks a free slot
+} hash_index_entry;
+
+typedef struct hash_index {
+    hash_index_entry* slots;
+    uint32_t capacity; // always a power of two (or 0 before first insert)
+    uint32_t count;    // keys in both tables
+
+    // Previous table while an incremental grow is in progress (NULL otherwise).
+    hash_index_entry* old_slots;
+    uint32_t old_capacity;
+    uint32_t old_count;   // keys not yet migrated out of old_slots
+    uint32_t migrate_pos; // next old slot to migrate
+} hash_index;
+
+/**
+ * @brief Initializes an empty index. No memory is allocated until the first insert.
+ */
+void hash_index_init(hash_index* idx);
+
+/**
+ * @brief Frees the index memory and resets it to empty.
+ */
+void hash_index_free(hash_index* idx);
+
+/**
+ * @brief Looks up a key.
+ * @param[out] value_out Receives the stored value (may be NULL).
+ * @return 0 if found, 1 if not found.
+ */
+int hash_index_find(const hash_index* idx, int key, uint32_t* value_out);
+
+/**
+ * @brief Inserts a new key.
+ * @param value Must not be HASH_INDEX_EMPTY.
+ * @return 0 on success, 1 if the key already exists, 2 if memory allocation fails.
+ */
+int hash_index_insert(hash_index* idx, int key, uint32_t value);
+
+/**
+ * @brief Overwrites the value of an existing key.
+ * @return 0 on success, 1 if not found.
+ */
+int hash_index_update(hash_index* idx, int key, uint32_t value);
+
+/**
+ * @brief Removes a key.
+ * @return 0 on success, 1 if not found.
+ */
+int hash_index_remove(hash_index* idx, int key);
+
+/**
+ * @brief Pre-sizes the table for 'count' keys so inserts up to that count never grow it.
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int hash_index_reserve(hash_index* idx, uint32_t count);
+
+/**
+ * @brief Extra bytes hash_index_reserve() would allocate for 'count' keys.
+ */
+size_t hash_index_reserve_cost(const hash_index* idx, uint32_t count);
+
+/**
+ * @brief Bytes currently held by the index.
+ */
+size_t hash_index_memory_usage(const hash_index* idx);
+
+/**
+ * @brief Bytes the next insert will allocate (0 unless it triggers a grow).
+ */
+size_t hash_index_insert_cost(const hash_index* idx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_HASH_INDEX_H
@@ -0,0 +1,120 @@
+#include "mapped_file.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int mapped_file_open(mapped_file* f, const char* path)
+{
+#ifdef _WIN32
+    f->handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f->handle == INVALID_HANDLE_VALUE) return 2;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f->handle, &size)) {
+        CloseHandle(f->handle);
+        return 2;
+    }
+    f->size = (uint64_t)size.QuadPart;
+#else
+    f->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (f->fd < 0) return 2;
+    struct stat st;
+    if (fstat(f->fd, &st) != 0) {
+        close(f->fd);
+        return 2;
+    }
+    f->size = (uint64_t)st.st_size;
+#endif
+    return 0;
+}
+
+int mapped_file_grow(mapped_file* f, uint64_t size)
+{
+    if (size <= f->size) return 0;
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(f->handle, end, NULL, FILE_BEGIN) || !SetEndOfFile(f->handle)) return 2;
+#else
+    if (ftruncate(f->fd, (off_t)size) != 0) return 2;
+#endif
+    f->size = size;
+    return 0;
+}
+
+void* mapped_file_map(mapped_file* f, uint64_t offset, size_t len)
+{
+    if (offset % MAPPED_FILE_ALIGN != 0 || offset + len > f->size) return NULL;
+#ifdef _WIN32
+    uint64_t end = offset + len;
+    HANDLE mapping = CreateFileMappingA(f->handle, NULL, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)end, NULL);
+    if (mapping == NULL) return NULL;
+    void* p = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD)(offset >> 32), (DWORD)offset, len);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    return p;
+#else
+    void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, f->fd, (off_t)offset);
+    return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+void mapped_file_unmap(void* addr, size_t len)
+{
+#ifdef _WIN32
+    (void)len;
+    UnmapViewOfFile(addr);
+#else
+    munmap(addr, len);
+#endif
+}
+
+int mapped_file_write(mapped_file* f, uint64_t offset, const void* buf, size_t len)
+{
+    const char* p = (const char*)buf;
+    while (len > 0) {
+#ifdef _WIN32
+        OVERLAPPED at;
+        memset(&at, 0, sizeof(at));
+        at.Offset = (DWORD)offset;
+        at.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD n = 0;
+        DWORD want = len > 0x40000000u ? 0x40000000u : (DWORD)len;
+        if (!WriteFile(f->handle, p, want, &n, &at) || n == 0) return 2;
+#else
+        ssize_t n = pwrite(f->fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 2;
+#endif
+        p += n;
+        offset += (uint64_t)n;
+        len -= (size_t)n;
+    }
+    if (offset > f->size) f->size = offset;
+    return 0;
+}
+
+int mapped_file_flush(mapped_file* f)
+{
+#ifdef _WIN32
+    return FlushFileBuffers(f->handle) ? 0 : 2;
+#else
+    return fsync(f->fd) == 0 ? 0 : 2;
+#endif
+}
+
+void mapped_file_close(mapped_file* f)
+{
+    mapped_file_flush(f);
+#ifdef _WIN32
+    CloseHandle(f->handle);
+#else
+    close(f->fd);
+#endif
+}
@@ -0,0 +1,77 @@
+#ifndef PBL_MAPPED_FILE_H
+#define PBL_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+// ------------------------------------------- MAPPED FILES -----------------------------------------------------
+// Private, copy-on-write memory maps of regions of one file (mmap
+// MAP_PRIVATE / MapViewOfFile FILE_MAP_COPY). A mapped region starts out as
+// the file's contents, but stores into it never reach the file: the OS
+// cannot write back a page at a moment the caller did not choose. The caller
+// puts bytes in the file itself with mapped_file_write().
+// Region offsets must be multiples of MAPPED_FILE_ALIGN.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAPPED_FILE_ALIGN 65536 // Windows' allocation granularity; a multiple of every page size
+
+typedef struct mapped_file {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    uint64_t size; // current file size
+} mapped_file;
+
+/**
+ * @brief Opens the file at 'path' for reading and writing, creating it if needed.
+ * @return 0 on success, 2 on failure.
+ */
+int mapped_file_open(mapped_file* f, const char* path);
+
+/**
+ * @brief Extends the file to at least 'size' bytes; the new bytes read as zero.
+ * @return 0 on success, 2 on failure.
+ */
+int mapped_file_grow(mapped_file* f, uint64_t size);
+
+/**
+ * @brief Maps [offset, offset + len) of the file, which must already be that long.
+ * @return The mapping, or NULL on failure.
+ */
+void* mapped_file_map(mapped_file* f, uint64_t offset, size_t len);
+
+/**
+ * @brief Unmaps a region returned by mapped_file_map().
+ */
+void mapped_file_unmap(void* addr, size_t len);
+
+/**
+ * @brief Writes 'len' bytes at 'offset' of the file (not through a mapping).
+ * @return 0 on success, 2 on failure.
+ */
+int mapped_file_write(mapped_file* f, uint64_t offset, const void* buf, size_t len);
+
+/**
+ * @brief Makes the file's size and everything written so far durable (fsync /
+ * FlushFileBuffers).
+ * @return 0 on success, 2 on failure.
+ */
+int mapped_file_flush(mapped_file* f);
+
+/**
+ * @brief Closes the file. Mappings stay valid until unmapped.
+ */
+void mapped_file_close(mapped_file* f);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_MAPPED_FILE_H
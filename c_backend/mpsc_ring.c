@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpsc_ring.h"
+
+// Slot layout: [int64 sequence][element]. A slot at position p is free for the
+// producer that claims ticket p while sequence == p, and holds a published
+// element while sequence == p + 1. Popping sets it to p + capacity, which
+// frees it for the next lap.
+
+static volatile int64_t* slot_seq(const mpsc_ring* r, int64_t pos)
+{
+    return (volatile int64_t*)(r->slots + (size_t)(pos & r->mask) * r->slot_size);
+}
+
+static void* slot_data(const mpsc_ring* r, int64_t pos)
+{
+    return r->slots + (size_t)(pos & r->mask) * r->slot_size + sizeof(int64_t);
+}
+
+int mpsc_ring_init(mpsc_ring* r, size_t elem_size, uint32_t capacity)
+{
+    uint32_t cap = 2;
+    while (cap < capacity && cap < 0x80000000u) cap *= 2;
+
+    memset(r, 0, sizeof(*r));
+    r->elem_size = elem_size;
+    r->slot_size = (sizeof(int64_t) + elem_size + 7) & ~(size_t)7;
+    r->mask = cap - 1;
+    r->slots = (unsigned char*)malloc((size_t)cap * r->slot_size);
+    if (r->slots == NULL) return 2;
+    for (uint32_t i = 0; i < cap; i++)
+        *slot_seq(r, i) = i;
+    return 0;
+}
+
+void mpsc_ring_free(mpsc_ring* r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
+
+int mpsc_ring_push(mpsc_ring* r, const void* elem, int64_t* ticket_out)
+{
+    int64_t pos = pbl_load64(&r->tail);
+    for (;;) {
+        int64_t seq = pbl_load64(slot_seq(r, pos));
+        int64_t diff = seq - pos;
+        if (diff == 0) {
+            if (pbl_cas64(&r->tail, pos, pos + 1)) break;
+            pos = pbl_load64(&r->tail);
+        } else if (diff < 0) {
+            return 1; // 1 = Full (the consumer has not freed this slot yet)
+        } else {
+            pos = pbl_load64(&r->tail); // another producer took it; try the next
+        }
+    }
+    memcpy(slot_data(r, pos), elem, r->elem_size);
+    pbl_store64(slot_seq(r, pos), pos + 1); // publish
+    if (ticket_out) *ticket_out = pos;
+    return 0;
+}
+
+int mpsc_ring_pop(mpsc_ring* r, void* out, int max)
+{
+    int64_t head = r->head;
+    int n = 0;
+    while (n < max) {
+        if (pbl_load64(slot_seq(r, head)) != head + 1) break; // empty, or still being written
+        memcpy((char*)out + (size_t)n * r->elem_size, slot_data(r, head), r->elem_size);
+        pbl_store64(slot_seq(r, head), head + (int64_t)r->mask + 1);
+        head++;
+        n++;
+    }
+    if (n > 0) pbl_store64(&r->head, head);
+    return n;
+}
+
+int64_t mpsc_ring_size(const mpsc_ring* r)
+{
+    int64_t size = pbl_load64(&r->tail) - pbl_load64(&r->head);
+    return size > 0 ? size : 0;
+}
+
+int mpsc_ring_peek(const mpsc_ring* r, int64_t offset, void* out)
+{
+    int64_t pos = pbl_load64(&r->head) + offset;
+    if (pbl_load64(slot_seq(r, pos)) != pos + 1) return 1;
+    memcpy(out, slot_data(r, pos), r->elem_size);
+    return 0;
+}
+
+size_t mpsc_ring_memory_usage(const mpsc_ring* r)
+{
+    return r->slots ? ((size_t)r->mask + 1) * r->slot_size : 0;
+}
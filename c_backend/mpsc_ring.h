@@ -0,0 +1,83 @@
+#ifndef PBL_MPSC_RING_H
+#define PBL_MPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+// ------------------------------------------- MPSC RING BUFFER -------------------------------------------------
+// Bounded lock-free queue of fixed-size elements: any number of threads push,
+// exactly one thread pops. Every slot carries a sequence number, so producers
+// claim a slot with a single CAS on the tail and publish it with a release
+// store of the slot's sequence; the consumer never writes anything the
+// producers spin on except that same sequence.
+//
+// Each successful push gets a ticket (its position in the ring, counting from
+// 0), which is also the order the consumer sees elements in.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mpsc_ring {
+    unsigned char* slots; // capacity * slot_size bytes
+    size_t elem_size;
+    size_t slot_size;     // sequence word + element, rounded up to 8 bytes
+    uint32_t mask;        // capacity - 1 (capacity is a power of two)
+
+    // Producers hammer the tail and the consumer owns the head; keep them on
+    // separate cache lines.
+    char pad0[PBL_CACHE_LINE];
+    volatile int64_t tail;
+    char pad1[PBL_CACHE_LINE - sizeof(int64_t)];
+    volatile int64_t head;
+    char pad2[PBL_CACHE_LINE - sizeof(int64_t)];
+} mpsc_ring;
+
+/**
+ * @brief Allocates a ring of 'capacity' elements (rounded up to a power of two).
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int mpsc_ring_init(mpsc_ring* r, size_t elem_size, uint32_t capacity);
+
+/**
+ * @brief Frees the ring memory. No thread may be using the ring.
+ */
+void mpsc_ring_free(mpsc_ring* r);
+
+/**
+ * @brief Copies 'elem' into the ring. Safe to call from any number of threads.
+ * @param[out] ticket_out Receives the element's position in the ring (may be NULL).
+ * @return 0 on success, 1 if the ring is full.
+ */
+int mpsc_ring_push(mpsc_ring* r, const void* elem, int64_t* ticket_out);
+
+/**
+ * @brief Moves up to 'max' elements into 'out', oldest first. Consumer thread only.
+ * @return The number of elements popped (0 if the ring is empty).
+ */
+int mpsc_ring_pop(mpsc_ring* r, void* out, int max);
+
+/**
+ * @brief Copies the element 'offset' places behind the oldest one into 'out'
+ * without popping it. The caller must keep the consumer from popping meanwhile.
+ * @return 0 on success, 1 if that element has not been published yet.
+ */
+int mpsc_ring_peek(const mpsc_ring* r, int64_t offset, void* out);
+
+/**
+ * @brief Memory held by the ring, in bytes.
+ */
+size_t mpsc_ring_memory_usage(const mpsc_ring* r);
+
+/**
+ * @brief Number of elements pushed (or being pushed) but not yet popped (a snapshot).
+ */
+int64_t mpsc_ring_size(const mpsc_ring* r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_MPSC_RING_H
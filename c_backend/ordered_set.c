@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ordered_set.h"
+
+#define ORDERED_SET_MIN_DIRECTORY 16
+
+// ------------------------------------------- (INTERNAL) HELPER FUNCTIONS ----------------------------------------
+
+// The leaf whose range holds 'key': the last leaf starting at or below it
+// (leaf 0 for a key below every leaf). The set must not be empty.
+static uint32_t leaf_for(const ordered_set* set, int64_t key)
+{
+    uint32_t lo = 0, hi = set->leaf_count; // answer in [lo, hi)
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((int64_t)set->leaves[mid]->keys[0] <= key) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Position of the first key in 'leaf' that is >= key.
+static uint32_t lower_bound(const ordered_set_leaf* leaf, int64_t key)
+{
+    uint32_t lo = 0, hi = leaf->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ((int64_t)leaf->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Inserts 'leaf' into the directory at position 'at'.
+static int add_leaf(ordered_set* set, uint32_t at, ordered_set_leaf* leaf)
+{
+    if (set->leaf_count == set->leaf_capacity) {
+        uint32_t cap = set->leaf_capacity ? set->leaf_capacity * 2 : ORDERED_SET_MIN_DIRECTORY;
+        ordered_set_leaf** bigger = (ordered_set_leaf**)realloc(set->leaves, cap * sizeof(ordered_set_leaf*));
+        if (bigger == NULL) return 2;
+        set->leaves = bigger;
+        set->leaf_capacity = cap;
+    }
+    memmove(set->leaves + at + 1, set->leaves + at, (set->leaf_count - at) * sizeof(ordered_set_leaf*));
+    set->leaves[at] = leaf;
+    set->leaf_count++;
+    return 0;
+}
+
+static void drop_leaf(ordered_set* set, uint32_t at)
+{
+    free(set->leaves[at]);
+    memmove(set->leaves + at, set->leaves + at + 1, (set->leaf_count - at - 1) * sizeof(ordered_set_leaf*));
+    set->leaf_count--;
+}
+
+// ------------------------------------------- PUBLIC API FUNCTIONS -----------------------------------------------
+
+void ordered_set_init(ordered_set* set)
+{
+    set->leaves = NULL;
+    set->leaf_count = 0;
+    set->leaf_capacity = 0;
+    set->size = 0;
+}
+
+void ordered_set_free(ordered_set* set)
+{
+    for (uint32_t i = 0; i < set->leaf_count; i++)
+        free(set->leaves[i]);
+    free(set->leaves);
+    ordered_set_init(set);
+}
+
+int ordered_set_insert(ordered_set* set, int key)
+{
+    if (set->leaf_count == 0) {
+        ordered_set_leaf* first = (ordered_set_leaf*)malloc(sizeof(ordered_set_leaf));
+        if (first == NULL) return 2;
+        first->count = 0;
+        if (add_leaf(set, 0, first) != 0) {
+            free(first);
+            return 2;
+        }
+    }
+    uint32_t li = leaf_for(set, key);
+    ordered_set_leaf* leaf = set->leaves[li];
+    uint32_t pos = lower_bound(leaf, key);
+    if (pos < leaf->count && leaf->keys[pos] == key) return 1;
+
+    if (leaf->count == ORDERED_SET_LEAF) {
+        // Split in half. Appending keys in order (the usual case for new
+        // account IDs) would leave every leaf half empty, so a full last
+        // leaf that the key goes past the end of starts a new leaf instead.
+        ordered_set_leaf* right = (ordered_set_leaf*)malloc(sizeof(ordered_set_leaf));
+        if (right == NULL) return 2;
+        uint32_t keep = (li + 1 == set->leaf_count && pos == leaf->count) ? leaf->count : leaf->count / 2;
+        right->count = leaf->count - keep;
+        memcpy(right->keys, leaf->keys + keep, right->count * sizeof(int));
+        if (right->count == 0) right->keys[0] = key; // a fresh leaf's range starts at the key
+        if (add_leaf(set, li + 1, right) != 0) {
+            free(right);
+            return 2;
+        }
+        leaf->count = keep;
+        if (pos >= keep) {
+            leaf = right;
+            pos -= keep;
+        }
+    }
+    memmove(leaf->keys + pos + 1, leaf->keys + pos, (leaf->count - pos) * sizeof(int));
+    leaf->keys[pos] = key;
+    leaf->count++;
+    set->size++;
+    return 0;
+}
+
+int ordered_set_remove(ordered_set* set, int key)
+{
+    if (set->leaf_count == 0) return 1;
+    uint32_t li = leaf_for(set, key);
+    ordered_set_leaf* leaf = set->leaves[li];
+    uint32_t pos = lower_bound(leaf, key);
+    if (pos == leaf->count || leaf->keys[pos] != key) return 1;
+    memmove(leaf->keys + pos, leaf->keys + pos + 1, (leaf->count - pos - 1) * sizeof(int));
+    leaf->count--;
+    set->size--;
+
+    if (leaf->count == 0) {
+        drop_leaf(set, li);
+    } else if (li + 1 < set->leaf_count && leaf->count + set->leaves[li + 1]->count <= ORDERED_SET_LEAF / 2) {
+        // Fold a thin neighbour in, so deletes cannot leave a directory of near-empty leaves.
+        ordered_set_leaf* next = set->leaves[li + 1];
+        memcpy(leaf->keys + leaf->count, next->keys, next->count * sizeof(int));
+        leaf->count += next->count;
+        drop_leaf(set, li + 1);
+    }
+    return 0;
+}
+
+uint32_t ordered_set_next(const ordered_set* set, int64_t after, int* out, uint32_t max)
+{
+    if (set->leaf_count == 0 || max == 0) return 0;
+    uint32_t li = leaf_for(set, after);
+    uint32_t pos = lower_bound(set->leaves[li], after);
+    uint32_t n = 0;
+    for (; li < set->leaf_count && n < max; li++, pos = 0) {
+        const ordered_set_leaf* leaf = set->leaves[li];
+        if (pos < leaf->count && (int64_t)leaf->keys[pos] == after) pos++;
+        uint32_t take = leaf->count - pos;
+        if (take > max - n) take = max - n;
+        memcpy(out + n, leaf->keys + pos, take * sizeof(int));
+        n += take;
+    }
+    return n;
+}
+
+size_t ordered_set_memory_usage(const ordered_set* set)
+{
+    return (size_t)set->leaf_count * sizeof(ordered_set_leaf) + (size_t)set->leaf_capacity * sizeof(ordered_set_leaf*);
+}
@@ -0,0 +1,70 @@
+#ifndef PBL_ORDERED_SET_H
+#define PBL_ORDERED_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------------------------- ORDERED SET ------------------------------------------------------
+// A set of int keys kept in ascending order, for walking keys in order from
+// any point (keyset pagination). Keys live in sorted leaves of up to
+// ORDERED_SET_LEAF keys, and a sorted directory points at the leaves. An
+// insert or remove shifts keys within one leaf (plus directory pointers when
+// a leaf splits or empties); finding where a key goes is two binary
+// searches. Reading the keys after some key costs O(log n + keys read).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ORDERED_SET_LEAF 512
+
+typedef struct ordered_set_leaf {
+    uint32_t count;
+    int keys[ORDERED_SET_LEAF];
+} ordered_set_leaf;
+
+typedef struct ordered_set {
+    ordered_set_leaf** leaves; // in key order, none empty
+    uint32_t leaf_count;
+    uint32_t leaf_capacity;
+    uint64_t size;             // keys in the set
+} ordered_set;
+
+/**
+ * @brief Initializes an empty set. No memory is allocated until the first insert.
+ */
+void ordered_set_init(ordered_set* set);
+
+/**
+ * @brief Frees the set's memory and resets it to empty.
+ */
+void ordered_set_free(ordered_set* set);
+
+/**
+ * @brief Adds a key.
+ * @return 0 on success, 1 if the key is already there, 2 if memory allocation fails.
+ */
+int ordered_set_insert(ordered_set* set, int key);
+
+/**
+ * @brief Removes a key.
+ * @return 0 on success, 1 if the key is not there.
+ */
+int ordered_set_remove(ordered_set* set, int key);
+
+/**
+ * @brief Copies up to 'max' keys greater than 'after' into 'out', in ascending order.
+ * @return The number of keys copied (fewer than 'max' only at the end of the set).
+ */
+uint32_t ordered_set_next(const ordered_set* set, int64_t after, int* out, uint32_t max);
+
+/**
+ * @brief Bytes currently held by the set.
+ */
+size_t ordered_set_memory_usage(const ordered_set* set);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_ORDERED_SET_H
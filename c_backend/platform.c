@@ -0,0 +1,286 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include <stdlib.h>
+
+#include "platform.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <errno.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// pthreads and Win32 want different thread entry signatures, so every thread
+// starts in a trampoline that unpacks the real function and argument.
+typedef struct thread_start {
+    pbl_thread_fn fn;
+    void* arg;
+} thread_start;
+
+#ifdef _WIN32
+static unsigned __stdcall thread_trampoline(void* p)
+#else
+static void* thread_trampoline(void* p)
+#endif
+{
+    thread_start start = *(thread_start*)p;
+    free(p);
+    start.fn(start.arg);
+    return 0;
+}
+
+int pbl_thread_start(pbl_thread* t, pbl_thread_fn fn, void* arg)
+{
+    thread_start* start = (thread_start*)malloc(sizeof(thread_start));
+    if (start == NULL) return 1;
+    start->fn = fn;
+    start->arg = arg;
+#ifdef _WIN32
+    uintptr_t h = _beginthreadex(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (h == 0) {
+        free(start);
+        return 1;
+    }
+    *t = (HANDLE)h;
+#else
+    if (pthread_create(t, NULL, thread_trampoline, start) != 0) {
+        free(start);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+void pbl_thread_join(pbl_thread t)
+{
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+int pbl_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int pbl_thread_pin(int cpu)
+{
+    if (cpu < 0 || cpu >= pbl_cpu_count()) return 1;
+#if defined(_WIN32)
+    if (cpu >= (int)(sizeof(DWORD_PTR) * 8)) return 1;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0 ? 0 : 1;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : 1;
+#else
+    return 1; // no portable affinity API (e.g. macOS); the thread stays unpinned
+#endif
+}
+
+void pbl_thread_yield()
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+int64_t pbl_now_ms()
+{
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+int pbl_file_sync(FILE* fp)
+{
+    if (fflush(fp) != 0) return 1;
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0 ? 0 : 1;
+#else
+    return fsync(fileno(fp)) == 0 ? 0 : 1;
+#endif
+}
+
+int pbl_replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : 1;
+#else
+    return rename(from, to) == 0 ? 0 : 1;
+#endif
+}
+
+#ifdef _WIN32
+int pbl_fork(pbl_child* child)
+{
+    (void)child;
+    return -1;
+}
+
+int pbl_child_send(const pbl_child* child, const void* buf, size_t len)
+{
+    (void)child;
+    (void)buf;
+    (void)len;
+    return 1;
+}
+
+int pbl_child_receive(const pbl_child* child, void* buf, size_t len)
+{
+    (void)child;
+    (void)buf;
+    (void)len;
+    return 1;
+}
+
+int pbl_child_wait(pbl_child* child)
+{
+    (void)child;
+    return -1;
+}
+
+void pbl_child_exit(int code)
+{
+    _exit(code);
+}
+
+int64_t pbl_private_dirty_bytes()
+{
+    return -1;
+}
+
+long pbl_page_size()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (long)info.dwPageSize;
+}
+#else
+int pbl_fork(pbl_child* child)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        child->pid = 0;
+        child->fd = fds[1];
+        return 0;
+    }
+    close(fds[1]);
+    child->pid = (long)pid;
+    child->fd = fds[0];
+    return 1;
+}
+
+int pbl_child_send(const pbl_child* child, const void* buf, size_t len)
+{
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(child->fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int pbl_child_receive(const pbl_child* child, void* buf, size_t len)
+{
+    char* p = (char*)buf;
+    while (len > 0) {
+        ssize_t n = read(child->fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int pbl_child_wait(pbl_child* child)
+{
+    int status = 0;
+    close(child->fd);
+    child->fd = -1;
+    while (waitpid((pid_t)child->pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void pbl_child_exit(int code)
+{
+    _exit(code);
+}
+
+int64_t pbl_private_dirty_bytes()
+{
+#ifdef __linux__
+    FILE* fp = fopen("/proc/self/smaps_rollup", "r");
+    if (fp == NULL) return -1;
+    char line[128];
+    int64_t kb = -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        long long v;
+        if (sscanf(line, "Private_Dirty: %lld kB", &v) == 1) {
+            kb = v;
+            break;
+        }
+    }
+    fclose(fp);
+    return kb < 0 ? -1 : kb * 1024;
+#else
+    return -1;
+#endif
+}
+
+long pbl_page_size()
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+void pbl_cond_timedwait_ms(pbl_cond* c, pbl_mutex* m, long ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(c, m, &deadline);
+}
+#endif
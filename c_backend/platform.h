@@ -0,0 +1,228 @@
+#ifndef PBL_PLATFORM_H
+#define PBL_PLATFORM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// ------------------------------------------- PLATFORM SHIMS ---------------------------------------------------
+// Threads, locks and atomics for the backend. POSIX builds use pthreads and
+// the GCC/Clang __atomic builtins; Windows builds use SRW locks, condition
+// variables and the Interlocked intrinsics. Every lock type has a static
+// initializer so globals never need a separate init call.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PBL_CACHE_LINE 64
+
+#ifdef _MSC_VER
+#define PBL_THREAD_LOCAL __declspec(thread)
+#else
+#define PBL_THREAD_LOCAL __thread
+#endif
+
+// --- Locks ---
+
+#ifdef _WIN32
+typedef SRWLOCK pbl_mutex;
+typedef SRWLOCK pbl_rwlock;
+typedef CONDITION_VARIABLE pbl_cond;
+#define PBL_MUTEX_INIT SRWLOCK_INIT
+#define PBL_RWLOCK_INIT SRWLOCK_INIT
+#define PBL_COND_INIT CONDITION_VARIABLE_INIT
+
+static inline void pbl_mutex_lock(pbl_mutex* m) { AcquireSRWLockExclusive(m); }
+static inline int pbl_mutex_trylock(pbl_mutex* m) { return TryAcquireSRWLockExclusive(m) ? 0 : 1; }
+static inline void pbl_mutex_unlock(pbl_mutex* m) { ReleaseSRWLockExclusive(m); }
+static inline void pbl_rwlock_rdlock(pbl_rwlock* l) { AcquireSRWLockShared(l); }
+static inline void pbl_rwlock_rdunlock(pbl_rwlock* l) { ReleaseSRWLockShared(l); }
+static inline void pbl_rwlock_wrlock(pbl_rwlock* l) { AcquireSRWLockExclusive(l); }
+static inline void pbl_rwlock_wrunlock(pbl_rwlock* l) { ReleaseSRWLockExclusive(l); }
+static inline void pbl_cond_wait(pbl_cond* c, pbl_mutex* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static inline void pbl_cond_timedwait_ms(pbl_cond* c, pbl_mutex* m, long ms) { SleepConditionVariableSRW(c, m, (DWORD)ms, 0); }
+static inline void pbl_cond_signal(pbl_cond* c) { WakeConditionVariable(c); }
+static inline void pbl_cond_broadcast(pbl_cond* c) { WakeAllConditionVariable(c); }
+#else
+typedef pthread_mutex_t pbl_mutex;
+typedef pthread_rwlock_t pbl_rwlock;
+typedef pthread_cond_t pbl_cond;
+#define PBL_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define PBL_RWLOCK_INIT PTHREAD_RWLOCK_INITIALIZER
+#define PBL_COND_INIT PTHREAD_COND_INITIALIZER
+
+static inline void pbl_mutex_lock(pbl_mutex* m) { pthread_mutex_lock(m); }
+static inline int pbl_mutex_trylock(pbl_mutex* m) { return pthread_mutex_trylock(m) == 0 ? 0 : 1; }
+static inline void pbl_mutex_unlock(pbl_mutex* m) { pthread_mutex_unlock(m); }
+static inline void pbl_rwlock_rdlock(pbl_rwlock* l) { pthread_rwlock_rdlock(l); }
+static inline void pbl_rwlock_rdunlock(pbl_rwlock* l) { pthread_rwlock_unlock(l); }
+static inline void pbl_rwlock_wrlock(pbl_rwlock* l) { pthread_rwlock_wrlock(l); }
+static inline void pbl_rwlock_wrunlock(pbl_rwlock* l) { pthread_rwlock_unlock(l); }
+static inline void pbl_cond_wait(pbl_cond* c, pbl_mutex* m) { pthread_cond_wait(c, m); }
+void pbl_cond_timedwait_ms(pbl_cond* c, pbl_mutex* m, long ms);
+static inline void pbl_cond_signal(pbl_cond* c) { pthread_cond_signal(c); }
+static inline void pbl_cond_broadcast(pbl_cond* c) { pthread_cond_broadcast(c); }
+#endif
+
+// --- Threads ---
+
+typedef void (*pbl_thread_fn)(void* arg);
+
+#ifdef _WIN32
+typedef HANDLE pbl_thread;
+#else
+typedef pthread_t pbl_thread;
+#endif
+
+/**
+ * @brief Starts a thread running fn(arg).
+ * @return 0 on success, 1 on failure.
+ */
+int pbl_thread_start(pbl_thread* t, pbl_thread_fn fn, void* arg);
+
+/**
+ * @brief Waits for a thread started with pbl_thread_start() to finish.
+ */
+void pbl_thread_join(pbl_thread t);
+
+/**
+ * @brief Number of logical CPUs (at least 1).
+ */
+int pbl_cpu_count();
+
+/**
+ * @brief Pins the calling thread to one CPU.
+ * @return 0 on success, 1 if the CPU is invalid or pinning is unsupported.
+ */
+int pbl_thread_pin(int cpu);
+
+/**
+ * @brief Gives up the rest of the calling thread's time slice.
+ */
+void pbl_thread_yield();
+
+/**
+ * @brief Milliseconds from a monotonic clock (unaffected by wall-clock changes).
+ */
+int64_t pbl_now_ms();
+
+// --- Files ---
+
+/**
+ * @brief Flushes a stdio stream and forces its data to disk (fsync).
+ * @return 0 on success, 1 on failure.
+ */
+int pbl_file_sync(FILE* fp);
+
+/**
+ * @brief Renames 'from' to 'to', replacing 'to' if it exists.
+ * @return 0 on success, 1 on failure.
+ */
+int pbl_replace_file(const char* from, const char* to);
+
+// --- Child processes ---
+// fork() gives the child a copy-on-write image of the whole process (only
+// the forking thread carries on in it). Windows has no equivalent, so
+// pbl_fork() always fails there.
+
+#ifdef _WIN32
+#define PBL_HAS_FORK 0
+#else
+#define PBL_HAS_FORK 1
+#endif
+
+typedef struct pbl_child {
+    long pid;
+    int fd; // parent: read end of a pipe from the child; child: its write end
+} pbl_child;
+
+/**
+ * @brief Forks. The child must not take locks other threads may have held,
+ * and leaves with pbl_child_exit().
+ * @return 0 in the child, 1 in the parent, -1 if forking failed or is unsupported.
+ */
+int pbl_fork(pbl_child* child);
+
+/**
+ * @brief Child side: sends 'len' bytes to the parent.
+ * @return 0 on success, 1 on failure.
+ */
+int pbl_child_send(const pbl_child* child, const void* buf, size_t len);
+
+/**
+ * @brief Parent side: waits for 'len' bytes from the child.
+ * @return 0 once they arrived, 1 if the child closed the pipe (or exited) first.
+ */
+int pbl_child_receive(const pbl_child* child, void* buf, size_t len);
+
+/**
+ * @brief Parent side: waits for the child to exit and closes the pipe.
+ * @return The child's exit code, or -1 if it was killed.
+ */
+int pbl_child_wait(pbl_child* child);
+
+/**
+ * @brief Ends the child at once (no atexit handlers, no stdio flushing of the parent's buffers).
+ */
+void pbl_child_exit(int code);
+
+/**
+ * @brief Bytes of memory only this process maps and has written (Private_Dirty
+ * in /proc/self/smaps_rollup); in a forked child, the pages copied on write
+ * plus its own allocations.
+ * @return The byte count, or -1 where it is unavailable.
+ */
+int64_t pbl_private_dirty_bytes();
+
+/**
+ * @brief The virtual memory page size.
+ */
+long pbl_page_size();
+
+// --- Atomics (sequentially consistent unless noted) ---
+
+#ifdef _MSC_VER
+static inline int64_t pbl_load64(const volatile int64_t* p) { return *p; } // aligned 64-bit loads are atomic on x64
+static inline void pbl_store64(volatile int64_t* p, int64_t v) { _InterlockedExchange64((volatile long long*)p, v); }
+static inline int64_t pbl_fetch_add64(volatile int64_t* p, int64_t v) { return _InterlockedExchangeAdd64((volatile long long*)p, v); }
+static inline int pbl_cas64(volatile int64_t* p, int64_t expected, int64_t desired)
+{
+    return _InterlockedCompareExchange64((volatile long long*)p, desired, expected) == expected;
+}
+static inline void* pbl_load_ptr(void* const volatile* p) { return *p; }
+static inline void pbl_store_ptr(void* volatile* p, void* v) { _InterlockedExchangePointer((void* volatile*)p, v); }
+static inline void pbl_cpu_relax() { YieldProcessor(); }
+static inline void pbl_fence_acquire() { _ReadWriteBarrier(); } // x64 never reorders loads with loads
+#else
+static inline int64_t pbl_load64(const volatile int64_t* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+static inline void pbl_store64(volatile int64_t* p, int64_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+static inline int64_t pbl_fetch_add64(volatile int64_t* p, int64_t v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+static inline int pbl_cas64(volatile int64_t* p, int64_t expected, int64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+static inline void* pbl_load_ptr(void* const volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void pbl_store_ptr(void* volatile* p, void* v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline void pbl_fence_acquire() { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+#if defined(__x86_64__) || defined(__i386__)
+static inline void pbl_cpu_relax() { __builtin_ia32_pause(); }
+#else
+static inline void pbl_cpu_relax() { }
+#endif
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_PLATFORM_H
@@ -0,0 +1,451 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_log.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define READ_CHUNK (1u << 20)
+#define MAX_RECORD 0x7FFFFFF0u
+
+// ---- FILE SHIMS ----
+
+static int file_open(const char* path)
+{
+#ifdef _WIN32
+    return _open(path, _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return open(path, O_RDWR | O_CREAT, 0644);
+#endif
+}
+
+static long file_read(int fd, void* buf, size_t len)
+{
+#ifdef _WIN32
+    return _read(fd, buf, (unsigned)len);
+#else
+    return (long)read(fd, buf, len);
+#endif
+}
+
+// Writes all 'len' bytes at the current offset. Returns 0 on success.
+static int file_write(int fd, const unsigned char* buf, size_t len)
+{
+    while (len > 0)
+    {
+#ifdef _WIN32
+        long n = _write(fd, buf, len > 0x40000000u ? 0x40000000u : (unsigned)len);
+#else
+        long n = (long)write(fd, buf, len);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int file_sync(int fd)
+{
+#if defined(_WIN32)
+    return _commit(fd) == 0 ? 0 : 1;
+#elif defined(__APPLE__)
+    return fsync(fd) == 0 ? 0 : 1;
+#else
+    return fdatasync(fd) == 0 ? 0 : 1;
+#endif
+}
+
+// Cuts the file to 'len' bytes and moves the offset to its end.
+static int file_truncate(int fd, int64_t len)
+{
+#ifdef _WIN32
+    if (_chsize_s(fd, len) != 0) return 1;
+    return _lseeki64(fd, len, SEEK_SET) == len ? 0 : 1;
+#else
+    if (ftruncate(fd, (off_t)len) != 0) return 1;
+    return lseek(fd, (off_t)len, SEEK_SET) == (off_t)len ? 0 : 1;
+#endif
+}
+
+static int64_t file_seek(int fd, int64_t offset, int whence)
+{
+#ifdef _WIN32
+    return _lseeki64(fd, offset, whence);
+#else
+    return (int64_t)lseek(fd, (off_t)offset, whence);
+#endif
+}
+
+static void file_close(int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+// ---- CRC-32C ----
+// Castagnoli polynomial, reflected, one table lookup per byte. The table is
+// built by whichever thread gets there first.
+
+static uint32_t crcTable[256];
+static volatile int64_t crcTableState = 0; // 0 = not built, 1 = being built, 2 = ready
+
+static void ensure_crc_table()
+{
+    if (pbl_load64(&crcTableState) == 2) return;
+    if (pbl_cas64(&crcTableState, 0, 1))
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            crcTable[i] = c;
+        }
+        pbl_store64(&crcTableState, 2);
+        return;
+    }
+    while (pbl_load64(&crcTableState) != 2)
+        pbl_thread_yield();
+}
+
+static uint32_t crc32c(const unsigned char* p, size_t len)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++)
+        c = crcTable[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static uint32_t get_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(unsigned char* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// ---- REPLAY ----
+
+// 1 if bytes [from, size) of the file are all zero (a file extended ahead of
+// the data written into it), 0 if not, -1 on a read error. Uses 'buf' as scratch.
+static int zero_from(int fd, int64_t from, int64_t size, unsigned char* buf, size_t cap)
+{
+    if (from >= size) return 1;
+    if (file_seek(fd, from, SEEK_SET) != from) return -1;
+    for (int64_t left = size - from; left > 0;)
+    {
+        long n = file_read(fd, buf, left < (int64_t)cap ? (size_t)left : cap);
+        if (n <= 0) return -1;
+        for (long i = 0; i < n; i++)
+            if (buf[i] != 0) return 0;
+        left -= n;
+    }
+    return 1;
+}
+
+// Reads records from the start of the file into 'visit'. Sets *end to the
+// offset after the last good record. A bad record only ends the log if it
+// is a torn tail: an incomplete last record, or a damaged one followed by
+// nothing but zeros. A damaged record with data after it, an impossible
+// length, or an intact record 'visit' rejects means the log is corrupt.
+// Returns 0 once the file is consumed or a torn tail is found, 3 if the log
+// is corrupt, 2 on a read error, out of memory or an aborted visit.
+static int replay(int fd, int64_t size, record_log_visit visit, void* arg, int64_t* end, int64_t* records)
+{
+    size_t cap = READ_CHUNK;
+    unsigned char* buf = (unsigned char*)malloc(cap);
+    if (buf == NULL) return 2;
+
+    size_t have = 0;  // bytes in buf
+    size_t pos = 0;   // start of the next record in buf
+    int eof = 0;
+    int result = 0;
+    int64_t badEnd = 0;   // where the bad record ends, or starts if 'visit' rejected it
+    *end = 0;
+    for (;;)
+    {
+        size_t avail = have - pos;
+        uint32_t len = avail >= RECORD_LOG_HEADER ? get_le32(buf + pos) : 0;
+        if (avail >= RECORD_LOG_HEADER && len > MAX_RECORD)
+        {
+            badEnd = *end; // appends never write such a length, so it is not a torn write
+            break;
+        }
+        size_t need = RECORD_LOG_HEADER + (size_t)len;
+        if (avail < need)
+        {
+            if (eof)
+            {
+                badEnd = size; // incomplete final record: torn tail
+                break;
+            }
+            // Keep the partial record and read more behind it.
+            memmove(buf, buf + pos, avail);
+            have = avail;
+            pos = 0;
+            if (need > cap)
+            {
+                unsigned char* bigger = (unsigned char*)realloc(buf, need);
+                if (bigger == NULL) { result = 2; break; }
+                buf = bigger;
+                cap = need;
+            }
+            long n = file_read(fd, buf + have, cap - have);
+            if (n < 0) { result = 2; break; }
+            if (n == 0) eof = 1;
+            have += (size_t)n;
+            continue;
+        }
+
+        const unsigned char* payload = buf + pos + RECORD_LOG_HEADER;
+        if (crc32c(payload, len) != get_le32(buf + pos + 4))
+        {
+            badEnd = *end + (int64_t)need;
+            break;
+        }
+        int v = visit(payload, len, arg);
+        if (v == 1)
+        {
+            badEnd = *end; // intact, so only torn if it is itself zeros
+            break;
+        }
+        if (v != 0) { result = 2; break; }
+        pos += need;
+        *end += (int64_t)need;
+        (*records)++;
+    }
+    if (result == 0 && *end < size && badEnd < size)
+    {
+        // A bad record before the end of the file: torn only if zeros follow.
+        int zero = zero_from(fd, badEnd, size, buf, cap);
+        if (zero < 0) result = 2;
+        else if (!zero) result = 3;
+    }
+    free(buf);
+    return result;
+}
+
+// ---- PUBLIC API ----
+
+int record_log_open(record_log* log, const char* path, int mode, record_log_visit visit, void* arg)
+{
+    const pbl_mutex freshLock = PBL_MUTEX_INIT;
+    const pbl_cond freshCond = PBL_COND_INIT;
+    memset(log, 0, sizeof(*log));
+    log->fd = -1;
+    log->mode = mode;
+    log->lock = freshLock;
+    log->flushed = freshCond;
+    ensure_crc_table();
+
+    size_t pathLen = strlen(path);
+    log->path = (char*)malloc(pathLen + 1);
+    if (log->path == NULL) return 2;
+    memcpy(log->path, path, pathLen + 1);
+
+    int fd = file_open(path);
+    if (fd < 0)
+    {
+        free(log->path);
+        log->path = NULL;
+        return 2;
+    }
+
+    int64_t end = 0;
+    int64_t size = file_seek(fd, 0, SEEK_END);
+    int replayed = size < 0 || file_seek(fd, 0, SEEK_SET) != 0 ? 2 : replay(fd, size, visit, arg, &end, &log->records);
+    if (replayed != 0)
+    {
+        file_close(fd);
+        free(log->path);
+        log->path = NULL;
+        return replayed;
+    }
+    if (size < end || file_truncate(fd, end) != 0)
+    {
+        file_close(fd);
+        free(log->path);
+        log->path = NULL;
+        return 2;
+    }
+    log->dropped = size - end;
+    log->fd = fd;
+    log->appended = log->durable = end;
+    return 0;
+}
+
+unsigned char* record_log_begin(record_log* log, uint32_t maxLen)
+{
+    pbl_mutex_lock(&log->lock);
+    if (log->fd < 0 || log->failed)
+    {
+        pbl_mutex_unlock(&log->lock);
+        return NULL;
+    }
+    size_t need = log->len + RECORD_LOG_HEADER + maxLen;
+    if (need > log->cap || maxLen > MAX_RECORD)
+    {
+        size_t cap = log->cap ? log->cap : 4096;
+        while (cap < need) cap *= 2;
+        unsigned char* bigger = maxLen > MAX_RECORD ? NULL : (unsigned char*)realloc(log->buf, cap);
+        if (bigger == NULL)
+        {
+            // The record is lost, so nothing after it may follow it into the file.
+            log->failed = 1;
+            pbl_mutex_unlock(&log->lock);
+            fprintf(stderr, "record log: out of memory, no further records will be written\n");
+            return NULL;
+        }
+        log->buf = bigger;
+        log->cap = cap;
+    }
+    return log->buf + log->len + RECORD_LOG_HEADER;
+}
+
+void record_log_end(record_log* log, uint32_t len)
+{
+    unsigned char* p = log->buf + log->len;
+    put_le32(p, len);
+    put_le32(p + 4, crc32c(p + RECORD_LOG_HEADER, len));
+    log->len += RECORD_LOG_HEADER + (size_t)len;
+    log->appended += RECORD_LOG_HEADER + (int64_t)len;
+    log->records++;
+    pbl_mutex_unlock(&log->lock);
+}
+
+int record_log_append(record_log* log, const void* payload, uint32_t len)
+{
+    unsigned char* p = record_log_begin(log, len);
+    if (p == NULL) return 2;
+    memcpy(p, payload, len);
+    record_log_end(log, len);
+    return 0;
+}
+
+int record_log_flush(record_log* log)
+{
+    pbl_mutex_lock(&log->lock);
+    int64_t target = log->appended;
+    while (log->durable < target && !log->failed)
+    {
+        if (log->flushing)
+        {
+            pbl_cond_wait(&log->flushed, &log->lock);
+            continue;
+        }
+        // Lead: take every record appended so far and let appends carry on
+        // into the other buffer while we write.
+        unsigned char* out = log->buf;
+        size_t outLen = log->len;
+        size_t outCap = log->cap;
+        int64_t upTo = log->appended;
+        log->buf = log->spare;
+        log->cap = log->spareCap;
+        log->len = 0;
+        log->spare = out;
+        log->spareCap = outCap;
+        log->flushing = 1;
+        pbl_mutex_unlock(&log->lock);
+
+        int failed = file_write(log->fd, out, outLen) != 0 ||
+                     (log->mode == RECORD_LOG_SYNC && file_sync(log->fd) != 0);
+        if (failed)
+            fprintf(stderr, "record log: write failed (%s), no further records will be written\n", strerror(errno));
+
+        pbl_mutex_lock(&log->lock);
+        log->flushing = 0;
+        log->flushes++;
+        if (failed) log->failed = 1;
+        else log->durable = upTo;
+        pbl_cond_broadcast(&log->flushed);
+    }
+    int result = log->durable >= target ? 0 : 2;
+    pbl_mutex_unlock(&log->lock);
+    return result;
+}
+
+int record_log_rotate(record_log* log, const char* oldPath)
+{
+    pbl_mutex_lock(&log->lock);
+    while (log->flushing)
+        pbl_cond_wait(&log->flushed, &log->lock);
+    if (log->fd < 0 || log->failed)
+    {
+        pbl_mutex_unlock(&log->lock);
+        return 2;
+    }
+
+    // Appends are locked out until the new file is in place, so write the
+    // tail ourselves rather than as a leader.
+    int failed = file_write(log->fd, log->buf, log->len) != 0 ||
+                 (log->mode == RECORD_LOG_SYNC && file_sync(log->fd) != 0);
+    file_close(log->fd);
+    log->fd = -1;
+    if (!failed)
+    {
+        log->len = 0;
+        log->durable = log->appended;
+        failed = pbl_replace_file(log->path, oldPath) != 0;
+    }
+    if (!failed)
+    {
+        log->fd = file_open(log->path);
+        failed = log->fd < 0 || file_truncate(log->fd, 0) != 0;
+        log->fileStart = log->appended;
+    }
+    if (failed)
+    {
+        fprintf(stderr, "record log: could not rotate %s (%s), no further records will be written\n",
+                log->path, strerror(errno));
+        log->failed = 1;
+    }
+    pbl_cond_broadcast(&log->flushed);
+    pbl_mutex_unlock(&log->lock);
+    return failed ? 2 : 0;
+}
+
+int64_t record_log_size(record_log* log)
+{
+    pbl_mutex_lock(&log->lock);
+    int64_t size = log->appended - log->fileStart;
+    pbl_mutex_unlock(&log->lock);
+    return size;
+}
+
+void record_log_stats(record_log* log, int64_t* records, int64_t* flushes)
+{
+    pbl_mutex_lock(&log->lock);
+    *records = log->records;
+    *flushes = log->flushes;
+    pbl_mutex_unlock(&log->lock);
+}
+
+void record_log_close(record_log* log)
+{
+    if (log->path == NULL) return;
+    record_log_flush(log);
+    if (log->fd >= 0) file_close(log->fd);
+    free(log->buf);
+    free(log->spare);
+    free(log->path);
+    log->fd = -1;
+    log->path = NULL;
+    log->buf = log->spare = NULL;
+    log->len = log->cap = log->spareCap = 0;
+}
@@ -0,0 +1,129 @@
+#ifndef PBL_RECORD_LOG_H
+#define PBL_RECORD_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+// ------------------------------------------- RECORD LOG -------------------------------------------------------
+// Append-only file of length-prefixed, checksummed records:
+//   [u32 payload length][u32 CRC-32C of the payload][payload]   (little-endian)
+//
+// Appending only copies the record into memory. record_log_flush() makes
+// everything appended so far durable with group commit: the first caller to
+// find no flush running becomes the leader and writes (and syncs) every record
+// appended up to that moment in one go, while callers arriving meanwhile wait
+// for it and then hand the next leader everything they appended in the
+// meantime. However many threads append concurrently, each write + sync
+// covers all of them.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RECORD_LOG_HEADER 8
+
+#define RECORD_LOG_WRITE 1 // flush = write to the OS (survives a crash of the process)
+#define RECORD_LOG_SYNC 2  // flush = write + fdatasync (survives a power loss)
+
+/**
+ * @brief Called for each record found when a log is opened, oldest first.
+ * @return 0 to continue, 1 if the record is unusable (the log is then
+ * corrupt, see record_log_open()), 2 to abort the open (e.g. out of memory).
+ */
+typedef int (*record_log_visit)(const unsigned char* payload, uint32_t len, void* arg);
+
+typedef struct record_log {
+    int fd;               // -1 while closed
+    int mode;             // RECORD_LOG_WRITE or RECORD_LOG_SYNC
+    pbl_mutex lock;
+    pbl_cond flushed;     // signalled whenever a leader finishes
+    unsigned char* buf;   // records appended since the current flush started
+    size_t len;
+    size_t cap;
+    unsigned char* spare; // the buffer the leader is writing (swapped with buf)
+    size_t spareCap;
+    char* path;
+    int64_t appended;     // bytes appended since open, across rotations
+    int64_t durable;      // bytes of those flushed
+    int64_t fileStart;    // 'appended' when the current file was started
+    int flushing;         // 1 while a leader is writing
+    int failed;           // sticky: an append or write failed, the log takes no more records
+    int64_t records;      // records replayed + appended
+    int64_t flushes;      // writes (+ syncs) done by leaders
+    int64_t dropped;      // bytes of torn tail cut off the end by the last open
+} record_log;
+
+/**
+ * @brief Opens (creating if needed) the log at 'path' and passes every valid
+ * record to 'visit'. A torn tail, meaning a damaged last record, or one
+ * followed only by zeros (as a crash mid-write leaves it), is cut off (see
+ * 'dropped') so new records follow the last good one. Anything else wrong
+ * is corruption, and nothing is cut off: a damaged record with data after
+ * it, or an intact record 'visit' rejects.
+ * @return 0 on success, 2 if the file cannot be opened or read, memory runs
+ * out, or 'visit' aborted, 3 if the log is corrupt (the file is left as it
+ * is). The log is closed on failure; records before the failure have been
+ * visited.
+ */
+int record_log_open(record_log* log, const char* path, int mode, record_log_visit visit, void* arg);
+
+/**
+ * @brief Copies one record into the log's memory buffer. Thread-safe.
+ * record_log_begin() / record_log_end() do the same without the copy.
+ * @return 0 on success, 2 if the log is closed or has failed, or memory runs out.
+ */
+int record_log_append(record_log* log, const void* payload, uint32_t len);
+
+/**
+ * @brief Starts a record of at most 'maxLen' bytes and returns where to
+ * encode it, straight into the log's buffer. The log stays locked until
+ * record_log_end(), so keep the encoding short.
+ * @return The payload pointer, or NULL if the log is closed or has failed, or
+ * memory runs out (which fails the log; nothing is locked then).
+ */
+unsigned char* record_log_begin(record_log* log, uint32_t maxLen);
+
+/**
+ * @brief Finishes the record started by record_log_begin(); 'len' is its
+ * actual length (at most maxLen).
+ */
+void record_log_end(record_log* log, uint32_t len);
+
+/**
+ * @brief Returns once every record appended before the call is flushed
+ * (written, and synced in RECORD_LOG_SYNC mode). Thread-safe.
+ * @return 0 on success (or if the log is closed), 2 if a write or sync failed.
+ */
+int record_log_flush(record_log* log);
+
+/**
+ * @brief Flushes the log, renames its file to 'oldPath' (which must not
+ * exist) and carries on in a new, empty file. Appends wait meanwhile, so
+ * every record is in exactly one of the two files.
+ * @return 0 on success, 2 if a write, the rename or the new file fails (the
+ * log has then failed).
+ */
+int record_log_rotate(record_log* log, const char* oldPath);
+
+/**
+ * @brief Bytes in the current file, counting records not flushed yet.
+ */
+int64_t record_log_size(record_log* log);
+
+/**
+ * @brief Records replayed and appended since the log was opened, and flushes done.
+ */
+void record_log_stats(record_log* log, int64_t* records, int64_t* flushes);
+
+/**
+ * @brief Flushes and closes the log. No other thread may be using it.
+ */
+void record_log_close(record_log* log);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_RECORD_LOG_H
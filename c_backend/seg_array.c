@@ -0,0 +1,78 @@
+#include <stdlib.h>
+
+#include "seg_array.h"
+
+void seg_array_init(seg_array* a, size_t elem_size)
+{
+    a->chunks = NULL;
+    a->elem_size = elem_size;
+    a->chunk_count = 0;
+    a->file = NULL;
+    a->file_offset = 0;
+}
+
+void seg_array_free(seg_array* a)
+{
+    for (uint32_t i = 0; i < a->chunk_count; i++) {
+        if (a->file) mapped_file_unmap(a->chunks[i], seg_array_chunk_bytes(a));
+        else free(a->chunks[i]);
+    }
+    free(a->chunks);
+    a->chunks = NULL;
+    a->chunk_count = 0;
+    a->file = NULL;
+    a->file_offset = 0;
+}
+
+int seg_array_map(seg_array* a, mapped_file* file, uint64_t offset, uint64_t count)
+{
+    if (a->chunks != NULL || offset % MAPPED_FILE_ALIGN != 0 || seg_array_chunk_bytes(a) % MAPPED_FILE_ALIGN != 0)
+        return 2;
+    a->file = file;
+    a->file_offset = offset;
+    if (seg_array_reserve(a, count) != 0) {
+        seg_array_free(a);
+        return 2;
+    }
+    return 0;
+}
+
+int seg_array_reserve(seg_array* a, uint64_t count)
+{
+    if (count > (uint64_t)SEG_DIR_SIZE * SEG_CHUNK_ELEMS) return 2;
+    if (a->chunks == NULL) {
+        // The directory is sized for the whole uint32_t range up front so it
+        // never has to be reallocated; untouched pages cost no real memory.
+        a->chunks = (char**)calloc(SEG_DIR_SIZE, sizeof(char*));
+        if (a->chunks == NULL) return 2;
+    }
+    while ((uint64_t)a->chunk_count * SEG_CHUNK_ELEMS < count) {
+        char* chunk;
+        if (a->file) {
+            uint64_t at = a->file_offset + (uint64_t)a->chunk_count * seg_array_chunk_bytes(a);
+            if (mapped_file_grow(a->file, at + seg_array_chunk_bytes(a)) != 0) return 2;
+            chunk = (char*)mapped_file_map(a->file, at, seg_array_chunk_bytes(a));
+        } else {
+            chunk = (char*)calloc(SEG_CHUNK_ELEMS, a->elem_size);
+        }
+        if (chunk == NULL) return 2;
+        a->chunks[a->chunk_count++] = chunk;
+    }
+    return 0;
+}
+
+uint64_t seg_array_capacity(const seg_array* a)
+{
+    return (uint64_t)a->chunk_count * SEG_CHUNK_ELEMS;
+}
+
+size_t seg_array_memory_usage(const seg_array* a)
+{
+    if (a->chunks == NULL) return 0;
+    return (size_t)a->chunk_count * seg_array_chunk_bytes(a) + SEG_DIR_SIZE * sizeof(char*);
+}
+
+size_t seg_array_chunk_bytes(const seg_array* a)
+{
+    return (size_t)SEG_CHUNK_ELEMS * a->elem_size;
+}
@@ -0,0 +1,88 @@
+#ifndef PBL_SEG_ARRAY_H
+#define PBL_SEG_ARRAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mapped_file.h"
+
+// ------------------------------------------- SEGMENTED ARRAY --------------------------------------------------
+// A growable array built from fixed-size chunks. Growing allocates one new
+// chunk and never moves existing elements, so element pointers stay valid
+// and there is no O(n) copy when the array gets large.
+//
+// The chunks can also be regions of a file (seg_array_map()): chunk k is
+// mapped from file_offset + k * seg_array_chunk_bytes(), and growing extends
+// the file. The elements then start out as the file's contents; the mapping
+// is private (see MAPPED FILES), so changes reach the file only when the
+// caller writes them there.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEG_CHUNK_SHIFT 16                       // 65536 elements per chunk
+#define SEG_CHUNK_ELEMS (1u << SEG_CHUNK_SHIFT)
+#define SEG_DIR_SIZE (1u << (32 - SEG_CHUNK_SHIFT)) // enough chunks for any uint32_t index
+
+typedef struct seg_array {
+    char** chunks;       // SEG_DIR_SIZE entries, NULL until the chunk is allocated
+    size_t elem_size;
+    uint32_t chunk_count; // chunks [0, chunk_count) are allocated
+    mapped_file* file;    // NULL = chunks on the heap
+    uint64_t file_offset; // where chunk 0 starts in 'file'
+} seg_array;
+
+/**
+ * @brief Initializes an empty array of elements of 'elem_size' bytes.
+ */
+void seg_array_init(seg_array* a, size_t elem_size);
+
+/**
+ * @brief Backs an empty array with 'file' from 'offset' (a multiple of
+ * MAPPED_FILE_ALIGN) on, and maps the chunks holding its first 'count'
+ * elements. The caller keeps the file open while the array is in use.
+ * @return 0 on success, 2 if the file cannot be grown or mapped (the array is then empty again).
+ */
+int seg_array_map(seg_array* a, mapped_file* file, uint64_t offset, uint64_t count);
+
+/**
+ * @brief Frees (or unmaps) every chunk and the chunk directory.
+ */
+void seg_array_free(seg_array* a);
+
+/**
+ * @brief Makes sure indices [0, count) are backed by memory. New chunks are
+ * zero-filled (in a mapped array, new chunks are mapped from the grown file).
+ * @return 0 on success, 2 if memory allocation (or growing the file) fails.
+ */
+int seg_array_reserve(seg_array* a, uint64_t count);
+
+/**
+ * @brief Number of elements currently backed by memory.
+ */
+uint64_t seg_array_capacity(const seg_array* a);
+
+/**
+ * @brief Bytes held by the array (chunks plus directory).
+ */
+size_t seg_array_memory_usage(const seg_array* a);
+
+/**
+ * @brief Bytes the next chunk allocation will cost.
+ */
+size_t seg_array_chunk_bytes(const seg_array* a);
+
+/**
+ * @brief Pointer to element 'i'. The caller must have reserved it.
+ */
+static inline void* seg_array_at(const seg_array* a, uint32_t i)
+{
+    return a->chunks[i >> SEG_CHUNK_SHIFT] + (size_t)(i & (SEG_CHUNK_ELEMS - 1)) * a->elem_size;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_SEG_ARRAY_H
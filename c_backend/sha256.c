@@ -0,0 +1,461 @@
+#include <string.h>
+
+#include "platform.h"
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SHA256_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA256_TARGET(features) // MSVC compiles any intrinsic without a flag
+#else
+#include <cpuid.h>
+#define SHA256_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t H256[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t load_be32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void store_be32(unsigned char* p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// ---- PORTABLE ENGINE ----
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compress_portable(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; i++)
+            w[i] = load_be32(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+            uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) | (c & (a | b)));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        data += 64;
+    }
+}
+
+#ifdef SHA256_X86
+
+// ---- SHA-NI ENGINE ----
+// The SHA extensions keep the state as two registers, ABEF and CDGH, and run
+// two rounds per sha256rnds2; the message schedule is sha256msg1/msg2.
+
+// Four rounds on message words W[4g..4g+3] (already in 'msg').
+#define SHANI_ROUNDS(msg, g)                                                         \
+    do {                                                                             \
+        __m128i wk = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i*)&K256[4 * (g)])); \
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);                                \
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));       \
+    } while (0)
+
+// W[4g..4g+3] from the previous sixteen words: m0 = W[4g-16..], m1 = W[4g-12..],
+// m2 = W[4g-8..], m3 = W[4g-4..]. The result replaces m0.
+#define SHANI_SCHEDULE(m0, m1, m2, m3) \
+    m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3)
+
+SHA256_TARGET("sha,sse4.1,ssse3")
+static void compress_shani(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i dcba = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i hgfe = _mm_loadu_si128((const __m128i*)&state[4]);
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    while (blocks--) {
+        __m128i abefSaved = abef, cdghSaved = cdgh;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), bswap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        SHANI_ROUNDS(m0, 0);
+        SHANI_ROUNDS(m1, 1);
+        SHANI_ROUNDS(m2, 2);
+        SHANI_ROUNDS(m3, 3);
+        for (int g = 4; g < 16; g += 4) {
+            SHANI_SCHEDULE(m0, m1, m2, m3);
+            SHANI_ROUNDS(m0, g);
+            SHANI_SCHEDULE(m1, m2, m3, m0);
+            SHANI_ROUNDS(m1, g + 1);
+            SHANI_SCHEDULE(m2, m3, m0, m1);
+            SHANI_ROUNDS(m2, g + 2);
+            SHANI_SCHEDULE(m3, m0, m1, m2);
+            SHANI_ROUNDS(m3, g + 3);
+        }
+
+        abef = _mm_add_epi32(abef, abefSaved);
+        cdgh = _mm_add_epi32(cdgh, cdghSaved);
+        data += 64;
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(feba, dchg, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(dchg, feba, 8));    // HGFE
+}
+
+// ---- AVX2 MULTI-BUFFER ENGINE ----
+// Lane i of every register belongs to message i, so one pass of the ordinary
+// round function advances eight messages by one 64-byte block each.
+
+#define V_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// Loads one block from each of the eight lanes as sixteen big-endian word vectors:
+// w[j] holds word j of every lane.
+SHA256_TARGET("avx2")
+static void load_lanes_avx2(const unsigned char* const lane[SHA256_LANES], __m256i w[16])
+{
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (int half = 0; half < 2; half++) {
+        // r[i] = words 8*half .. 8*half+7 of lane i; transpose the 8x8 tile.
+        __m256i r[8], t[8], u[8];
+        for (int i = 0; i < 8; i++)
+            r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(lane[i] + 32 * half)), bswap);
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+        for (int i = 0; i < 4; i++) {
+            w[8 * half + i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+            w[8 * half + i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+        }
+    }
+}
+
+SHA256_TARGET("avx2")
+static void compress_avx2(__m256i s[8], const unsigned char* const lane[SHA256_LANES])
+{
+    __m256i w[16];
+    load_lanes_avx2(lane, w);
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        __m256i wi;
+        if (i < 16) {
+            wi = w[i];
+        } else {
+            __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(w15, 7), V_ROR(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(w2, 17), V_ROR(w2, 19)), _mm256_srli_epi32(w2, 10));
+            wi = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+            w[i & 15] = wi;
+        }
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(e, 6), V_ROR(e, 11)), V_ROR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1),
+                                      _mm256_add_epi32(_mm256_add_epi32(ch, wi), _mm256_set1_epi32((int)K256[i])));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(V_ROR(a, 2), V_ROR(a, 13)), V_ROR(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, _mm256_add_epi32(S0, maj));
+    }
+    s[0] = _mm256_add_epi32(s[0], a);
+    s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c);
+    s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e);
+    s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g);
+    s[7] = _mm256_add_epi32(s[7], h);
+}
+
+// Hashes up to eight messages side by side. Each message is read straight
+// from the caller's buffer except its last one or two blocks, which are
+// copied into a padded tail; lanes that run out early (or are unused) chew on
+// a block of zeros and their state is ignored after their digest is taken.
+SHA256_TARGET("avx2")
+static void hash_lanes_avx2(const unsigned char* const* data, const size_t* len, int count,
+                            unsigned char (*out)[SHA256_DIGEST_LEN])
+{
+    static const unsigned char zeros[64] = {0};
+    unsigned char tail[SHA256_LANES][128];
+    size_t fullBlocks[SHA256_LANES], totalBlocks[SHA256_LANES], maxBlocks = 0;
+
+    for (int i = 0; i < SHA256_LANES; i++) {
+        if (i >= count) {
+            fullBlocks[i] = totalBlocks[i] = 0;
+            continue;
+        }
+        size_t rest = len[i] % 64;
+        fullBlocks[i] = len[i] / 64;
+        size_t tailLen = rest + 9 <= 64 ? 64 : 128;
+        memset(tail[i], 0, tailLen);
+        memcpy(tail[i], data[i] + fullBlocks[i] * 64, rest);
+        tail[i][rest] = 0x80;
+        uint64_t bits = (uint64_t)len[i] * 8;
+        store_be32(tail[i] + tailLen - 8, (uint32_t)(bits >> 32));
+        store_be32(tail[i] + tailLen - 4, (uint32_t)bits);
+        totalBlocks[i] = fullBlocks[i] + tailLen / 64;
+        if (totalBlocks[i] > maxBlocks) maxBlocks = totalBlocks[i];
+    }
+
+    __m256i s[8];
+    for (int j = 0; j < 8; j++)
+        s[j] = _mm256_set1_epi32((int)H256[j]);
+
+    for (size_t blk = 0; blk < maxBlocks; blk++) {
+        const unsigned char* lane[SHA256_LANES];
+        int finishing = 0;
+        for (int i = 0; i < SHA256_LANES; i++) {
+            if (blk < fullBlocks[i]) lane[i] = data[i] + blk * 64;
+            else if (blk < totalBlocks[i]) lane[i] = tail[i] + (blk - fullBlocks[i]) * 64;
+            else lane[i] = zeros;
+            if (blk + 1 == totalBlocks[i]) finishing = 1;
+        }
+        compress_avx2(s, lane);
+        if (!finishing) continue;
+
+        uint32_t words[8][SHA256_LANES];
+        for (int j = 0; j < 8; j++)
+            _mm256_storeu_si256((__m256i*)words[j], s[j]);
+        for (int i = 0; i < count; i++) {
+            if (blk + 1 != totalBlocks[i]) continue;
+            for (int j = 0; j < 8; j++)
+                store_be32(out[i] + 4 * j, words[j][i]);
+        }
+    }
+}
+
+// ---- CPU DETECTION ----
+
+static void cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4])
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; i++) r[i] = (uint32_t)regs[i];
+#else
+    if (!__get_cpuid_count(leaf, sub, &r[0], &r[1], &r[2], &r[3]))
+        r[0] = r[1] = r[2] = r[3] = 0;
+#endif
+}
+
+// OS support for saving the YMM registers (needed before using AVX at all).
+static int os_saves_ymm()
+{
+    uint32_t r[4];
+    cpuid(1, 0, r);
+    if (!(r[2] & (1u << 27))) return 0; // no OSXSAVE
+#ifdef _MSC_VER
+    uint64_t xcr0 = _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    uint64_t xcr0 = ((uint64_t)hi << 32) | lo;
+#endif
+    return (xcr0 & 6) == 6;
+}
+
+static int detect_engines()
+{
+    uint32_t r1[4], r7[4];
+    cpuid(0, 0, r1);
+    if (r1[0] < 7) return 1 << SHA256_PORTABLE;
+    cpuid(1, 0, r1);
+    cpuid(7, 0, r7);
+    int supported = 1 << SHA256_PORTABLE;
+    int sse41 = (r1[2] & (1u << 19)) != 0 && (r1[2] & (1u << 9)) != 0; // SSE4.1 and SSSE3
+    if ((r7[1] & (1u << 29)) && sse41) supported |= 1 << SHA256_SHANI;
+    if ((r7[1] & (1u << 5)) && os_saves_ymm()) supported |= 1 << SHA256_AVX2;
+    return supported;
+}
+
+#else
+
+static int detect_engines()
+{
+    return 1 << SHA256_PORTABLE;
+}
+
+#endif // SHA256_X86
+
+// ---- DISPATCH ----
+// Bit mask of usable engines, filled in on first use (racing threads compute
+// the same value). Bit 31 marks it as initialized.
+
+static volatile int64_t enginesAllowed = 0;
+
+static int engines()
+{
+    int64_t e = pbl_load64(&enginesAllowed);
+    if (e == 0) {
+        e = detect_engines() | ((int64_t)1 << 31);
+        pbl_store64(&enginesAllowed, e);
+    }
+    return (int)e;
+}
+
+static void compress(uint32_t state[8], const unsigned char* data, size_t blocks)
+{
+#ifdef SHA256_X86
+    if (engines() & (1 << SHA256_SHANI)) {
+        compress_shani(state, data, blocks);
+        return;
+    }
+#endif
+    compress_portable(state, data, blocks);
+}
+
+int sha256_engine_supported(int engine)
+{
+    return engine >= 0 && engine <= SHA256_SHANI && (detect_engines() & (1 << engine)) != 0;
+}
+
+int sha256_use_engine(int engine)
+{
+    if (!sha256_engine_supported(engine)) return 1;
+    int mask = detect_engines() & ((2 << engine) - 1);
+    pbl_store64(&enginesAllowed, mask | ((int64_t)1 << 31));
+    return 0;
+}
+
+const char* sha256_engine_name(int multi)
+{
+    int e = engines();
+    if (e & (1 << SHA256_SHANI)) return "sha-ni";
+    if (multi && (e & (1 << SHA256_AVX2))) return "avx2";
+    return "portable";
+}
+
+// ---- PUBLIC API ----
+
+void sha256_init(sha256_ctx* ctx)
+{
+    memcpy(ctx->state, H256, sizeof(H256));
+    ctx->length = 0;
+}
+
+void sha256_update(sha256_ctx* ctx, const void* data, size_t len)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    size_t used = (size_t)(ctx->length % 64);
+    ctx->length += len;
+
+    if (used > 0) {
+        size_t take = 64 - used < len ? 64 - used : len;
+        memcpy(ctx->block + used, p, take);
+        p += take;
+        len -= take;
+        if (used + take < 64) return;
+        compress(ctx->state, ctx->block, 1);
+    }
+    if (len >= 64) {
+        compress(ctx->state, p, len / 64);
+        p += len & ~(size_t)63;
+        len %= 64;
+    }
+    memcpy(ctx->block, p, len);
+}
+
+void sha256_final(sha256_ctx* ctx, unsigned char out[SHA256_DIGEST_LEN])
+{
+    uint64_t bits = ctx->length * 8;
+    size_t used = (size_t)(ctx->length % 64);
+    ctx->block[used++] = 0x80;
+    if (used > 56) {
+        memset(ctx->block + used, 0, 64 - used);
+        compress(ctx->state, ctx->block, 1);
+        used = 0;
+    }
+    memset(ctx->block + used, 0, 56 - used);
+    store_be32(ctx->block + 56, (uint32_t)(bits >> 32));
+    store_be32(ctx->block + 60, (uint32_t)bits);
+    compress(ctx->state, ctx->block, 1);
+    for (int i = 0; i < 8; i++)
+        store_be32(out + 4 * i, ctx->state[i]);
+}
+
+void sha256(const void* data, size_t len, unsigned char out[SHA256_DIGEST_LEN])
+{
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, out);
+}
+
+void sha256_many(const unsigned char* const* data, const size_t* len, int count,
+                 unsigned char (*out)[SHA256_DIGEST_LEN])
+{
+#ifdef SHA256_X86
+    // One SHA-NI stream beats eight AVX2 lanes, so multi-buffer only pays off
+    // on CPUs without the SHA extensions.
+    int e = engines();
+    if (count > 1 && (e & (1 << SHA256_AVX2)) && !(e & (1 << SHA256_SHANI))) {
+        for (int i = 0; i < count; i += SHA256_LANES) {
+            int n = count - i < SHA256_LANES ? count - i : SHA256_LANES;
+            hash_lanes_avx2(data + i, len + i, n, out + i);
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++)
+        sha256(data[i], len[i], out[i]);
+}
@@ -0,0 +1,71 @@
+#ifndef PBL_SHA256_H
+#define PBL_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ------------------------------------------- SHA-256 ----------------------------------------------------------
+// FIPS 180-4 SHA-256 with three compression engines picked at runtime from
+// what the CPU supports:
+//   SHA256_SHANI    - x86 SHA extensions, one message at a time
+//   SHA256_AVX2     - eight independent messages per pass, one per 32-bit
+//                     lane; used by sha256_many() on CPUs without SHA-NI
+//                     (single messages fall back to the portable code)
+//   SHA256_PORTABLE - plain C, works everywhere
+// All engines produce identical digests; the choice only affects speed.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_DIGEST_LEN 32
+#define SHA256_LANES 8 // messages hashed together by the AVX2 engine
+
+#define SHA256_PORTABLE 0
+#define SHA256_AVX2 1
+#define SHA256_SHANI 2
+
+typedef struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t length;          // bytes fed so far
+    unsigned char block[64];  // partial block waiting for more input
+} sha256_ctx;
+
+void sha256_init(sha256_ctx* ctx);
+void sha256_update(sha256_ctx* ctx, const void* data, size_t len);
+void sha256_final(sha256_ctx* ctx, unsigned char out[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief One-shot digest of 'len' bytes.
+ */
+void sha256(const void* data, size_t len, unsigned char out[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief Digests 'count' independent messages; out[i] receives the digest of
+ * data[i]. Uses the AVX2 multi-buffer engine when the CPU lacks SHA-NI.
+ */
+void sha256_many(const unsigned char* const* data, const size_t* len, int count,
+                 unsigned char (*out)[SHA256_DIGEST_LEN]);
+
+/**
+ * @brief Whether this CPU can run the given engine.
+ */
+int sha256_engine_supported(int engine);
+
+/**
+ * @brief Restricts hashing to the given engine and the ones below it (mainly
+ * for benchmarks). The default is the best engine the CPU supports.
+ * @return 0 on success, 1 if the CPU does not support it.
+ */
+int sha256_use_engine(int engine);
+
+/**
+ * @brief Name of the engine in use for single messages and for sha256_many().
+ */
+const char* sha256_engine_name(int multi);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_SHA256_H
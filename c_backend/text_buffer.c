@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text_buffer.h"
+
+#define TEXT_BUFFER_MIN_CAPACITY 256
+
+void text_buffer_init(text_buffer* tb)
+{
+    tb->data = NULL;
+    tb->len = 0;
+    tb->cap = 0;
+}
+
+void text_buffer_free(text_buffer* tb)
+{
+    free(tb->data);
+    text_buffer_init(tb);
+}
+
+void text_buffer_clear(text_buffer* tb)
+{
+    tb->len = 0;
+    if (tb->data) tb->data[0] = 0;
+}
+
+int text_buffer_reserve(text_buffer* tb, size_t extra)
+{
+    if (extra >= (size_t)-1 - tb->len) return 2;
+    size_t need = tb->len + extra + 1;
+    if (need <= tb->cap) return 0;
+    size_t cap = tb->cap ? tb->cap : TEXT_BUFFER_MIN_CAPACITY;
+    while (cap < need) {
+        if (cap > (size_t)-1 / 2) {
+            cap = need;
+            break;
+        }
+        cap *= 2;
+    }
+    char* bigger = (char*)realloc(tb->data, cap);
+    if (bigger == NULL) return 2;
+    if (tb->data == NULL) bigger[0] = 0;
+    tb->data = bigger;
+    tb->cap = cap;
+    return 0;
+}
+
+int text_buffer_append(text_buffer* tb, const char* text, size_t len)
+{
+    if (text_buffer_reserve(tb, len) != 0) return 2;
+    memcpy(tb->data + tb->len, text, len);
+    tb->len += len;
+    tb->data[tb->len] = 0;
+    return 0;
+}
+
+int text_buffer_vprintf(text_buffer* tb, const char* fmt, va_list args)
+{
+    // Try in the space there is; only a line that does not fit is formatted twice.
+    if (text_buffer_reserve(tb, TEXT_BUFFER_MIN_CAPACITY - 1) != 0) return 2;
+    va_list retry;
+    va_copy(retry, args);
+    size_t room = tb->cap - tb->len;
+    int n = vsnprintf(tb->data + tb->len, room, fmt, args);
+    if (n >= 0 && (size_t)n >= room) {
+        if (text_buffer_reserve(tb, (size_t)n) != 0) {
+            tb->data[tb->len] = 0;
+            va_end(retry);
+            return 2;
+        }
+        n = vsnprintf(tb->data + tb->len, tb->cap - tb->len, fmt, retry);
+    }
+    va_end(retry);
+    if (n < 0) {
+        tb->data[tb->len] = 0;
+        return 2;
+    }
+    tb->len += (size_t)n;
+    return 0;
+}
+
+int text_buffer_printf(text_buffer* tb, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = text_buffer_vprintf(tb, fmt, args);
+    va_end(args);
+    return result;
+}
@@ -0,0 +1,70 @@
+#ifndef PBL_TEXT_BUFFER_H
+#define PBL_TEXT_BUFFER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// ------------------------------------------- TEXT BUFFERS -----------------------------------------------------
+// A growable, always NUL-terminated string owned by the caller. Appending
+// writes at the known end (no strlen of what is already there) and the
+// capacity doubles, so rendering n bytes costs O(n) however it is split up.
+// text_buffer_clear() keeps the memory, so a buffer reused page after page
+// stops allocating once it has grown to the largest page.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct text_buffer {
+    char* data; // NULL until the first append
+    size_t len;
+    size_t cap;
+} text_buffer;
+
+/**
+ * @brief Initializes an empty buffer. No memory is allocated until the first append.
+ */
+void text_buffer_init(text_buffer* tb);
+
+/**
+ * @brief Frees the buffer's memory and resets it to empty.
+ */
+void text_buffer_free(text_buffer* tb);
+
+/**
+ * @brief Empties the buffer, keeping its memory.
+ */
+void text_buffer_clear(text_buffer* tb);
+
+/**
+ * @brief Makes room for 'extra' more bytes (plus the terminator).
+ * @return 0 on success, 2 if memory allocation fails.
+ */
+int text_buffer_reserve(text_buffer* tb, size_t extra);
+
+/**
+ * @brief Appends 'len' bytes.
+ * @return 0 on success, 2 if memory allocation fails (the buffer is unchanged).
+ */
+int text_buffer_append(text_buffer* tb, const char* text, size_t len);
+
+/**
+ * @brief Appends printf-style formatted text.
+ * @return 0 on success, 2 if memory allocation (or formatting) fails (the buffer is unchanged).
+ */
+int text_buffer_printf(text_buffer* tb, const char* fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/**
+ * @brief text_buffer_printf() with a va_list.
+ */
+int text_buffer_vprintf(text_buffer* tb, const char* fmt, va_list args);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_TEXT_BUFFER_H
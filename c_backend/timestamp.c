@@ -0,0 +1,42 @@
+#include <string.h>
+#include <time.h>
+
+#include "platform.h"
+#include "timestamp.h"
+
+// Last second this thread formatted, and its text.
+static PBL_THREAD_LOCAL int64_t cachedSecond = -1;
+static PBL_THREAD_LOCAL char cachedText[TIMESTAMP_TEXT_LEN];
+
+int64_t timestamp_now_us()
+{
+#ifdef _WIN32
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    int64_t ticks = ((int64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime; // 100 ns since 1601
+    return (ticks - 116444736000000000LL) / 10;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+void timestamp_format(int64_t us, char out[TIMESTAMP_TEXT_LEN])
+{
+    // Floor division, so times before 1970 land in the right second.
+    int64_t second = us >= 0 ? us / 1000000 : -((-us + 999999) / 1000000);
+    if (second != cachedSecond)
+    {
+        time_t t = (time_t)second;
+        struct tm tm_info;
+#ifdef _WIN32
+        localtime_s(&tm_info, &t);
+#else
+        localtime_r(&t, &tm_info);
+#endif
+        strftime(cachedText, sizeof(cachedText), "%Y-%m-%d %H:%M:%S", &tm_info);
+        cachedSecond = second;
+    }
+    memcpy(out, cachedText, TIMESTAMP_TEXT_LEN);
+}
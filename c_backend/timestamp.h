@@ -0,0 +1,33 @@
+#ifndef PBL_TIMESTAMP_H
+#define PBL_TIMESTAMP_H
+
+#include <stdint.h>
+
+// ------------------------------------------- TIMESTAMPS -------------------------------------------------------
+// Ledger records store the wall-clock time as microseconds since the Unix
+// epoch (UTC). Taking a timestamp is one clock read; turning it into local
+// time text only happens when something is rendered, and each thread
+// caches the text of the last second it formatted, so a page of records
+// from the same second costs one localtime call.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIMESTAMP_TEXT_LEN 20 // "YYYY-MM-DD HH:MM:SS" + terminator
+
+/**
+ * @brief Current wall-clock time in microseconds since the Unix epoch.
+ */
+int64_t timestamp_now_us();
+
+/**
+ * @brief Formats a timestamp as local "YYYY-MM-DD HH:MM:SS". Thread-safe.
+ */
+void timestamp_format(int64_t us, char out[TIMESTAMP_TEXT_LEN]);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // PBL_TIMESTAMP_H
@@ -1,5 +1,12 @@
 #include "httplib.h"
 #include <iostream>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include <signal.h> // For handling shutdown signals
 
 // Include your C backend API
@@ -12,13 +19,175 @@ httplib::Server svr;
 
 void handle_shutdown(int signal) {
     std::cout << "\nCaught signal " << signal << ". Shutting down..." << std::endl;
-    shutdown_system();
+    // Only stop the listener here; shutdown_system() runs in main() once the
+    // worker threads are done, so it never races an in-flight request.
     svr.stop();
 }
 
+// Reads a numeric setting from the environment, or returns 'fallback'.
+static long env_long(const char* name, long fallback) {
+    const char* value = std::getenv(name);
+    return (value && *value) ? std::atol(value) : fallback;
+}
+
+static std::string to_hex(const unsigned char* bytes, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(len * 2);
+    for (size_t i = 0; i < len; i++) {
+        out += digits[bytes[i] >> 4];
+        out += digits[bytes[i] & 15];
+    }
+    return out;
+}
+
+// Reads an optional non-negative integer query parameter; false if it is
+// present but not a number in [0, max].
+static bool param_count(const httplib::Request& req, const char* name, long fallback, long max, long& out) {
+    out = fallback;
+    if (!req.has_param(name)) return true;
+    std::istringstream in(req.get_param_value(name));
+    std::string extra;
+    return (in >> out) && !(in >> extra) && out >= 0 && out <= max;
+}
+
+// A text_buffer that lives as long as the response sending it.
+struct owned_text {
+    text_buffer text;
+    owned_text() { text_buffer_init(&text); }
+    ~owned_text() { text_buffer_free(&text); }
+};
+
+// Sends a rendered buffer as the whole body, straight from its memory
+// rather than through a copy into a std::string.
+static void send_text(httplib::Response& res, std::shared_ptr<owned_text> body, const char* content_type) {
+    size_t len = body->text.len;
+    res.set_content_provider(len, content_type, [body](size_t offset, size_t length, httplib::DataSink &sink) {
+        return sink.write(body->text.data + offset, length);
+    });
+}
+
+// Same wording as the single-operation endpoints.
+static const char* batch_message(int type, int result) {
+    if (result == 0) {
+        if (type == BATCH_DEPOSIT) return "Deposit successful!";
+        if (type == BATCH_WITHDRAW) return "Withdrawal successful!";
+        return "Transfer successful!";
+    }
+    if (result == 4) return "Ledger is out of memory.";
+    if (result == 5) return "Malformed operation.";
+    if (type == BATCH_TRANSFER) {
+        if (result == 1) return "Sender account not found.";
+        if (result == 2) return "Receiver account not found.";
+        return "Invalid amount or insufficient funds.";
+    }
+    if (result == 1) return "Account not found.";
+    if (result == 3) return "Insufficient funds.";
+    return type == BATCH_DEPOSIT ? "Invalid deposit amount." : "Invalid withdrawal amount.";
+}
+
+// Parses one line of a batch body: "deposit <id> <amount>",
+// "withdraw <id> <amount>" or "transfer <fromID> <toID> <amount>".
+static bool parse_batch_line(const std::string& line, batch_op& op) {
+    std::istringstream in(line);
+    std::string verb;
+    in >> verb;
+    op.type = 0;
+    op.id = op.toID = 0;
+    op.amount = 0;
+    op.result = 0;
+    if (verb == "deposit" || verb == "withdraw") {
+        op.type = (verb == "deposit") ? BATCH_DEPOSIT : BATCH_WITHDRAW;
+        in >> op.id >> op.amount;
+    } else if (verb == "transfer") {
+        op.type = BATCH_TRANSFER;
+        in >> op.id >> op.toID >> op.amount;
+    } else {
+        return false;
+    }
+    std::string extra;
+    return !in.fail() && !(in >> extra);
+}
+
 int main(void) {
     // 1. Initialize your C backend
+    // Optional sizing: VALMAX_MEMORY_BUDGET_MB caps the account/user tables,
+    // VALMAX_RESERVE_ACCOUNTS / VALMAX_RESERVE_USERS pre-allocate them.
+    long budget_mb = env_long("VALMAX_MEMORY_BUDGET_MB", 0);
+    set_memory_budget((size_t)budget_mb * 1024 * 1024);
+    // Ledger durability: VALMAX_LEDGER_SYNC=2 (default) fdatasyncs each group
+    // of sealed blocks before replying, 1 only writes them to the OS.
+    if (set_ledger_sync((int)env_long("VALMAX_LEDGER_SYNC", LEDGER_SYNC_FULL)) != 0) {
+        std::cerr << "Warning: invalid VALMAX_LEDGER_SYNC; using full sync." << std::endl;
+    }
+    // Checkpoints: VALMAX_CHECKPOINT_MS between snapshots (default 60000),
+    // VALMAX_CHECKPOINT_MB of state log that forces one sooner (default 64).
+    if (set_checkpoint_policy(env_long("VALMAX_CHECKPOINT_MS", 60000),
+                              (size_t)env_long("VALMAX_CHECKPOINT_MB", 64) * 1024 * 1024) != 0) {
+        std::cerr << "Warning: invalid checkpoint policy; using the defaults." << std::endl;
+    }
+    // Background snapshots: VALMAX_SNAPSHOT_MS between forked snapshots of
+    // accounts, users and the chain (default 0 = only via /api/admin/snapshot).
+    if (set_snapshot_interval(env_long("VALMAX_SNAPSHOT_MS", 0)) != 0) {
+        std::cerr << "Warning: invalid VALMAX_SNAPSHOT_MS; snapshots only on request." << std::endl;
+    }
     initialize_system();
+    // A log damaged before its end is left for an operator: starting on the
+    // part before the damage would fork history.
+    int state_status = get_checkpoint_stats(NULL, NULL, NULL);
+    long long ledger_blocks = 0, ledger_dropped = 0;
+    int ledger_status = get_ledger_log_stats(&ledger_blocks, NULL, &ledger_dropped);
+    if (state_status == 3 || ledger_status == 3) {
+        std::cerr << "Error: " << (ledger_status == 3 ? "ledger.log" : "state.wal")
+                  << " is corrupt before its end. Restore it from a snapshot, or move it aside to start without it." << std::endl;
+        return 1;
+    }
+    if (state_status != 0) {
+        std::cerr << "Warning: could not open state.wal; account changes are only saved at shutdown." << std::endl;
+    }
+    if (ledger_status != 0) {
+        std::cerr << "Warning: could not open ledger.log; the chain will not survive a restart." << std::endl;
+    } else {
+        std::cout << "Ledger: " << ledger_blocks << " blocks in ledger.log" << std::endl;
+        if (ledger_dropped > 0) {
+            std::cerr << "Warning: cut a torn " << ledger_dropped << "-byte tail off ledger.log." << std::endl;
+        }
+    }
+    if (reserve_capacity(env_long("VALMAX_RESERVE_ACCOUNTS", 0), env_long("VALMAX_RESERVE_USERS", 0)) != 0) {
+        std::cerr << "Warning: could not reserve the requested capacity." << std::endl;
+    }
+    if (budget_mb > 0) {
+        std::cout << "Memory budget: " << budget_mb << " MB (in use: "
+                  << get_memory_usage() / (1024 * 1024) << " MB)" << std::endl;
+    }
+    // Block sealing: VALMAX_BLOCK_MAX_TX transactions per block (default 1),
+    // VALMAX_BLOCK_MAX_MS longest wait before a partial block is sealed,
+    // VALMAX_BLOCK_MAX_BYTES cap on a block's transaction bytes (0 = none).
+    long block_tx = env_long("VALMAX_BLOCK_MAX_TX", 1);
+    long block_ms = env_long("VALMAX_BLOCK_MAX_MS", 0);
+    long block_bytes = env_long("VALMAX_BLOCK_MAX_BYTES", 0);
+    if (set_block_policy((int)block_tx, block_ms, (size_t)block_bytes) != 0) {
+        std::cerr << "Warning: invalid block policy; sealing one transaction per block." << std::endl;
+        set_block_policy(1, 0, 0);
+    } else if (block_tx != 1 || block_ms != 0 || block_bytes != 0) {
+        std::cout << "Block policy: " << block_tx << " tx / " << block_ms << " ms / "
+                  << block_bytes << " bytes" << std::endl;
+    }
+    // Chain validation threads: VALMAX_VALIDATE_THREADS (default 0 = one per CPU).
+    if (set_validation_threads((int)env_long("VALMAX_VALIDATE_THREADS", 0)) != 0) {
+        std::cerr << "Warning: invalid validation thread count; using one per CPU." << std::endl;
+    }
+    // VALMAX_SEQUENCER=1 routes every account mutation through one sequencer
+    // thread, pinned to VALMAX_SEQUENCER_CPU (default: the last CPU, -1 = unpinned).
+    if (env_long("VALMAX_SEQUENCER", 0) != 0) {
+        long last_cpu = (long)std::thread::hardware_concurrency() - 1;
+        int cpu = (int)env_long("VALMAX_SEQUENCER_CPU", last_cpu > 0 ? last_cpu : -1);
+        if (start_sequencer(cpu) != 0) {
+            std::cerr << "Warning: could not start the sequencer; using per-account locks." << std::endl;
+        } else {
+            std::cout << "Sequencer mode (CPU " << cpu << ")" << std::endl;
+        }
+    }
 
     // 2. Define API Endpoints
 
@@ -32,9 +201,12 @@ int main(void) {
             res.set_header("Content-Type", "application/json");
             if (result == 0) {
                 res.set_content("{\"success\": true, \"message\": \"Registration successful!\"}", "application/json");
+            } else if (result == 3) {
+                res.status = 409;
+                res.set_content("{\"success\": false, \"message\": \"User ID already exists.\"}", "application/json");
             } else {
                 res.status = 400;
-                res.set_content("{\"success\": false, \"message\": \"Registration failed. User limit reached?\"}", "application/json");
+                res.set_content("{\"success\": false, \"message\": \"Registration failed. Memory budget reached?\"}", "application/json");
             }
         } else {
             res.status = 400;
@@ -77,6 +249,9 @@ int main(void) {
             } else if (result == 3) {
                  res.status = 400;
                  res.set_content("{\"success\": false, \"message\": \"Account ID already exists.\"}", "application/json");
+            } else if (result == 1) {
+                res.status = 507;
+                res.set_content("{\"success\": false, \"message\": \"Account storage is full (memory budget reached).\"}", "application/json");
             } else {
                 res.status = 400;
                 res.set_content("{\"success\": false, \"message\": \"Failed to create account.\"}", "application/json");
@@ -99,6 +274,9 @@ int main(void) {
             } else if (result == 1) {
                 res.status = 404;
                 res.set_content("{\"success\": false, \"message\": \"Account not found.\"}", "application/json");
+            } else if (result == 4) {
+                res.status = 503;
+                res.set_content("{\"success\": false, \"message\": \"Ledger is out of memory.\"}", "application/json");
             } else {
                 res.status = 400;
                 res.set_content("{\"success\": false, \"message\": \"Invalid deposit amount.\"}", "application/json");
@@ -124,6 +302,9 @@ int main(void) {
             } else if (result == 3) {
                 res.status = 400;
                 res.set_content("{\"success\": false, \"message\": \"Insufficient funds.\"}", "application/json");
+            } else if (result == 4) {
+                res.status = 503;
+                res.set_content("{\"success\": false, \"message\": \"Ledger is out of memory.\"}", "application/json");
             } else {
                 res.status = 400;
                 res.set_content("{\"success\": false, \"message\": \"Invalid withdrawal amount.\"}", "application/json");
@@ -150,6 +331,9 @@ int main(void) {
             } else if (result == 2) {
                 res.status = 404;
                 res.set_content("{\"success\": false, \"message\": \"Receiver account not found.\"}", "application/json");
+            } else if (result == 4) {
+                res.status = 503;
+                res.set_content("{\"success\": false, \"message\": \"Ledger is out of memory.\"}", "application/json");
             } else {
                 res.status = 400;
                 res.set_content("{\"success\": false, \"message\": \"Invalid amount or insufficient funds.\"}", "application/json");
@@ -160,10 +344,181 @@ int main(void) {
         }
     });
 
+    // --- Batch of deposits / withdrawals / transfers ---
+    // The body holds one operation per line (see parse_batch_line); blank
+    // lines are ignored. Every line gets a result, in order. At most
+    // VALMAX_BATCH_MAX (default 10000) operations per request. Send it as
+    // text/plain: httplib caps form-encoded bodies at 8 KB.
+    svr.Post("/api/batch", [](const httplib::Request &req, httplib::Response &res) {
+        static const long max_ops = env_long("VALMAX_BATCH_MAX", 10000);
+        std::vector<batch_op> ops;
+        std::vector<bool> malformed;  // per line
+        std::istringstream body(req.body);
+        std::string line;
+        while (std::getline(body, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+            if (line.find_first_not_of(" \t") == std::string::npos) continue;
+            batch_op op;
+            bool ok = parse_batch_line(line, op);
+            malformed.push_back(!ok);
+            if (ok) {
+                ops.push_back(op);
+            }
+            if ((long)malformed.size() > max_ops) {
+                res.status = 413;
+                res.set_content("{\"success\": false, \"message\": \"Too many operations in one batch.\"}", "application/json");
+                return;
+            }
+        }
+        if (malformed.empty()) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"Missing batch operations.\"}", "application/json");
+            return;
+        }
+
+        int result = perform_batch(ops.data(), (int)ops.size());
+        if (result == 4) {
+            res.status = 503;
+            res.set_content("{\"success\": false, \"message\": \"Ledger is out of memory.\"}", "application/json");
+            return;
+        }
+
+        std::string out;
+        out.reserve(64 + malformed.size() * 64);
+        int applied = 0;
+        size_t next_op = 0;
+        out += "{\"success\": true, \"results\": [";
+        for (size_t i = 0; i < malformed.size(); i++) {
+            int type = BATCH_DEPOSIT, code = 5;
+            if (!malformed[i]) {
+                const batch_op& op = ops[next_op++];
+                type = op.type;
+                code = op.result;
+            }
+            if (code == 0) applied++;
+            if (i > 0) out += ", ";
+            out += "{\"success\": ";
+            out += code == 0 ? "true" : "false";
+            out += ", \"message\": \"";
+            out += batch_message(type, code);
+            out += "\"}";
+        }
+        out += "], \"applied\": " + std::to_string(applied) +
+               ", \"failed\": " + std::to_string((int)malformed.size() - applied) + "}";
+        res.set_content(out, "application/json");
+    });
+
     // --- Display Accounts (Module 5) ---
+    // ?format=json lists accounts as JSON, one page at a time: ?after=ID
+    // continues past that ID (the previous page's "nextAfter") and ?limit=N
+    // sets the page size (0 = every remaining account, for exports).
     svr.Get("/api/accounts", [](const httplib::Request &req, httplib::Response &res) {
-        const char* accounts_summary = get_all_accounts_summary();
-        res.set_content(accounts_summary, "text/plain; charset=utf-8");
+        if (req.get_param_value("format") != "json") {
+            auto body = std::make_shared<owned_text>();
+            if (render_accounts_summary(&body->text) != 0) {
+                res.status = 503;
+                res.set_content("Out of memory.\n", "text/plain; charset=utf-8");
+                return;
+            }
+            send_text(res, body, "text/plain; charset=utf-8");
+            return;
+        }
+        static const long page_size = env_long("VALMAX_ACCOUNTS_PAGE", 100);
+        static const int accounts_per_chunk = 1000;
+        struct account_stream {
+            long long after;
+            long long count;
+            long remaining;
+            text_buffer text;
+            bool started;
+            account_stream() : after(LLONG_MIN), count(0), remaining(0), started(false) { text_buffer_init(&text); }
+            ~account_stream() { text_buffer_free(&text); }
+        };
+        auto stream = std::make_shared<account_stream>();
+        long limit = 0;
+        bool bad = !param_count(req, "limit", page_size, INT_MAX, limit);
+        if (req.has_param("after")) {
+            std::istringstream in(req.get_param_value("after"));
+            std::string extra;
+            bad = bad || !(in >> stream->after) || (in >> extra);
+        }
+        if (bad) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"'after' must be an account ID and 'limit' a count.\"}", "application/json");
+            return;
+        }
+        stream->remaining = limit > 0 ? limit : LONG_MAX;
+        res.set_chunked_content_provider("application/json", [stream](size_t, httplib::DataSink &sink) {
+            text_buffer_clear(&stream->text);
+            if (!stream->started) {
+                stream->started = true;
+                static const char head[] = "{\"success\": true, \"accounts\": [";
+                if (text_buffer_append(&stream->text, head, sizeof(head) - 1) != 0) return false;
+            }
+            int want = stream->remaining < accounts_per_chunk ? (int)stream->remaining : accounts_per_chunk;
+            long long before = stream->count;
+            int more = 0;
+            if (render_accounts_json(&stream->after, want, &stream->text, &stream->count, &more) != 0) return false;
+            stream->remaining -= (long)(stream->count - before);
+            bool last = !more || stream->remaining == 0;
+            if (last) {
+                int result = more ? text_buffer_printf(&stream->text, "], \"count\": %lld, \"nextAfter\": %lld}",
+                                                       stream->count, stream->after)
+                                  : text_buffer_printf(&stream->text, "], \"count\": %lld, \"nextAfter\": null}",
+                                                       stream->count);
+                if (result != 0) return false;
+            }
+            if (!sink.write(stream->text.data, stream->text.len)) return false;
+            if (last) sink.done();
+            return true;
+        });
+    });
+
+    // --- Account statement: sealed transactions, newest first ---
+    // ?limit=N (1-1000, default 100); ?before=TX continues from the previous
+    // page's "nextBefore".
+    svr.Get("/api/account/:id/history", [](const httplib::Request &req, httplib::Response &res) {
+        int id = 0;
+        try {
+            id = std::stoi(req.path_params.at("id"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"Account ID is required.\"}", "application/json");
+            return;
+        }
+        long limit = 0;
+        long long before = LLONG_MAX;
+        bool bad = !param_count(req, "limit", 100, 1000, limit) || limit == 0;
+        if (req.has_param("before")) {
+            std::istringstream in(req.get_param_value("before"));
+            std::string extra;
+            bad = bad || !(in >> before) || (in >> extra);
+        }
+        if (bad) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"'before' must be a transaction ID and 'limit' 1-1000.\"}", "application/json");
+            return;
+        }
+        auto body = std::make_shared<owned_text>();
+        long long count = 0;
+        int more = 0;
+        int result = text_buffer_printf(&body->text, "{\"success\": true, \"id\": %d, \"transactions\": [", id);
+        if (result == 0) result = render_account_history(id, &before, (int)limit, &body->text, &count, &more);
+        if (result == 0) {
+            result = more ? text_buffer_printf(&body->text, "], \"nextBefore\": %lld}", before)
+                          : text_buffer_append(&body->text, "], \"nextBefore\": null}", 22);
+        }
+        if (result == 1) {
+            res.status = 404;
+            res.set_content("{\"success\": false, \"message\": \"Account not found.\"}", "application/json");
+            return;
+        }
+        if (result != 0) {
+            res.status = 503;
+            res.set_content("{\"success\": false, \"message\": \"Account history is unavailable (out of memory).\"}", "application/json");
+            return;
+        }
+        send_text(res, body, "application/json");
     });
 
     // --- NEW: Update Account (Module 6) ---
@@ -243,23 +598,267 @@ int main(void) {
     });
 
     // --- Display Blockchain (Module 9) ---
+    // The chain is streamed a few blocks at a time through one reused buffer,
+    // so even a very long chain goes out whole in bounded memory. Without
+    // parameters that is every block plus the pending transactions;
+    // ?from=H&limit=N is one page of blocks H..H+N-1, and X-Next-From says
+    // where the next page starts (absent on the last page).
     svr.Get("/api/blockchain", [](const httplib::Request &req, httplib::Response &res) {
-        const char* blockchain_data = get_blockchain_string();
-        res.set_content(blockchain_data, "text/plain; charset=utf-8");
+        static const int blocks_per_chunk = 64;
+        struct chain_stream {
+            block_cursor cursor;
+            text_buffer text;
+            long remaining;
+            bool paged;
+            chain_stream() : remaining(0), paged(false) { text_buffer_init(&text); }
+            ~chain_stream() { text_buffer_free(&text); }
+        };
+        auto stream = std::make_shared<chain_stream>();
+        stream->paged = req.has_param("from") || req.has_param("limit");
+        long from = 0;
+        stream->remaining = LONG_MAX;
+        if (stream->paged) {
+            if (!param_count(req, "from", 0, INT_MAX, from) ||
+                !param_count(req, "limit", 100, 1000, stream->remaining) || stream->remaining == 0) {
+                res.status = 400;
+                res.set_content("'from' must be a block height and 'limit' 1-1000.\n", "text/plain; charset=utf-8");
+                return;
+            }
+            long count = get_block_count();
+            if (from >= count) {
+                res.status = 404;
+                res.set_content("No block at that height.\n", "text/plain; charset=utf-8");
+                return;
+            }
+            if (from + stream->remaining < count) {
+                res.set_header("X-Next-From", std::to_string(from + stream->remaining));
+            }
+        }
+        if (block_cursor_seek(&stream->cursor, (int)from) != 0) {
+            res.status = 404;
+            res.set_content("No block at that height.\n", "text/plain; charset=utf-8");
+            return;
+        }
+        res.set_chunked_content_provider("text/plain; charset=utf-8", [stream](size_t, httplib::DataSink &sink) {
+            text_buffer_clear(&stream->text);
+            int want = stream->remaining < blocks_per_chunk ? (int)stream->remaining : blocks_per_chunk;
+            int rendered = 0;
+            if (render_blocks(&stream->cursor, want, &stream->text, &rendered) != 0) return false;
+            stream->remaining -= rendered;
+            bool last = rendered < want || stream->remaining == 0;
+            if (last && !stream->paged) {
+                if (stream->cursor.height == 0 && text_buffer_append(&stream->text, "Blockchain is empty.\n", 21) != 0) return false;
+                if (render_pending_transactions(&stream->text) != 0) return false;
+            }
+            if (stream->text.len > 0 && !sink.write(stream->text.data, stream->text.len)) return false;
+            if (last) sink.done();
+            return true;
+        });
+    });
+
+    // --- One block by height, and ranges of blocks, as JSON ---
+    svr.Get("/api/block/:height", [](const httplib::Request &req, httplib::Response &res) {
+        long height = 0;
+        std::istringstream in(req.path_params.at("height"));
+        std::string extra;
+        if (!(in >> height) || (in >> extra) || height < 0 || height > INT_MAX) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"Block height is required.\"}", "application/json");
+            return;
+        }
+        block_cursor cursor;
+        auto body = std::make_shared<owned_text>();
+        long long count = 0;
+        static const char head[] = "{\"success\": true, \"block\": ";
+        bool found = block_cursor_seek(&cursor, (int)height) == 0;
+        if (found && (text_buffer_append(&body->text, head, sizeof(head) - 1) != 0 ||
+                      render_blocks_json(&cursor, 1, &body->text, &count) != 0 ||
+                      text_buffer_append(&body->text, "}", 1) != 0)) {
+            res.status = 503;
+            res.set_content("{\"success\": false, \"message\": \"Out of memory.\"}", "application/json");
+            return;
+        }
+        if (count == 0) {
+            res.status = 404;
+            res.set_content("{\"success\": false, \"message\": \"No block at that height.\"}", "application/json");
+            return;
+        }
+        send_text(res, body, "application/json");
+    });
+
+    // ?from=H&limit=N (1-1000, default 100); "nextFrom" is the height after
+    // the last block returned, or null at the tail.
+    svr.Get("/api/blocks", [](const httplib::Request &req, httplib::Response &res) {
+        static const int blocks_per_chunk = 64;
+        struct block_stream {
+            block_cursor cursor;
+            text_buffer text;
+            long remaining;
+            long long count;
+            long long next_from; // -1 = null
+            bool started;
+            block_stream() : remaining(0), count(0), next_from(-1), started(false) { text_buffer_init(&text); }
+            ~block_stream() { text_buffer_free(&text); }
+        };
+        auto stream = std::make_shared<block_stream>();
+        long from = 0;
+        if (!param_count(req, "from", 0, INT_MAX, from) ||
+            !param_count(req, "limit", 100, 1000, stream->remaining) || stream->remaining == 0) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"'from' must be a block height and 'limit' 1-1000.\"}", "application/json");
+            return;
+        }
+        long count = get_block_count();
+        if (from >= count || block_cursor_seek(&stream->cursor, (int)from) != 0) {
+            res.status = 404;
+            res.set_content("{\"success\": false, \"message\": \"No block at that height.\"}", "application/json");
+            return;
+        }
+        if (from + stream->remaining < count) stream->next_from = from + stream->remaining;
+        res.set_chunked_content_provider("application/json", [stream](size_t, httplib::DataSink &sink) {
+            text_buffer_clear(&stream->text);
+            if (!stream->started) {
+                stream->started = true;
+                static const char head[] = "{\"success\": true, \"blocks\": [";
+                if (text_buffer_append(&stream->text, head, sizeof(head) - 1) != 0) return false;
+            }
+            int want = stream->remaining < blocks_per_chunk ? (int)stream->remaining : blocks_per_chunk;
+            long long before = stream->count;
+            if (render_blocks_json(&stream->cursor, want, &stream->text, &stream->count) != 0) return false;
+            long rendered = (long)(stream->count - before);
+            stream->remaining -= rendered;
+            bool last = rendered < want || stream->remaining == 0;
+            if (last) {
+                int result = stream->next_from >= 0
+                    ? text_buffer_printf(&stream->text, "], \"nextFrom\": %lld}", stream->next_from)
+                    : text_buffer_append(&stream->text, "], \"nextFrom\": null}", 20);
+                if (result != 0) return false;
+            }
+            if (!sink.write(stream->text.data, stream->text.len)) return false;
+            if (last) sink.done();
+            return true;
+        });
     });
 
     // --- NEW: Validate Blockchain (Module 10) ---
     svr.Get("/api/validate_chain", [](const httplib::Request &req, httplib::Response &res) {
         res.set_header("Content-Type", "application/json");
-        int result = perform_validate_chain();
-        if (result == 1) {
-            res.set_content("{\"success\": true, \"message\": \"Blockchain is valid and secure!\"}", "application/json");
+        // Routine checks only hash blocks added since the last check;
+        // ?mode=full audits the whole chain from genesis.
+        bool full = req.get_param_value("mode") == "full";
+        int bad_block = full ? audit_chain() : find_invalid_block();
+        std::string verified = ", \"verifiedBlocks\": " + std::to_string(get_verified_block_count()) + "}";
+        if (bad_block < 0) {
+            res.set_content("{\"success\": true, \"message\": \"Blockchain is valid and secure!\"" + verified, "application/json");
         } else {
             res.status = 500;
-            res.set_content("{\"success\": false, \"message\": \"DANGER: Blockchain validation FAILED. Chain is broken or has been tampered with.\"}", "application/json");
+            res.set_content("{\"success\": false, \"message\": \"DANGER: Blockchain validation FAILED. Chain is broken or has been tampered with.\", \"firstInvalidBlock\": "
+                            + std::to_string(bad_block) + verified, "application/json");
+        }
+    });
+
+    // --- One sealed transaction by ID ---
+    svr.Get("/api/tx/:id", [](const httplib::Request &req, httplib::Response &res) {
+        int tx_id = 0;
+        try {
+            tx_id = std::stoi(req.path_params.at("id"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"Transaction ID is required.\"}", "application/json");
+            return;
+        }
+
+        auto body = std::make_shared<owned_text>();
+        static const char head[] = "{\"success\": true, \"transaction\": ";
+        int block = 0, slot = 0;
+        int result = text_buffer_append(&body->text, head, sizeof(head) - 1);
+        if (result == 0) result = render_transaction(tx_id, &body->text, &block, &slot);
+        if (result == 1) {
+            res.status = 404;
+            res.set_content("{\"success\": false, \"message\": \"Transaction not found (or not sealed yet).\"}", "application/json");
+            return;
+        }
+        if (result != 0 || text_buffer_printf(&body->text, ", \"block\": %d, \"slot\": %d}", block, slot) != 0) {
+            res.status = 503;
+            res.set_content("{\"success\": false, \"message\": \"Out of memory.\"}", "application/json");
+            return;
+        }
+        send_text(res, body, "application/json");
+    });
+
+    // --- Merkle inclusion proof for one transaction ---
+    svr.Get("/api/tx/:id/proof", [](const httplib::Request &req, httplib::Response &res) {
+        int tx_id = 0;
+        try {
+            tx_id = std::stoi(req.path_params.at("id"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content("{\"success\": false, \"message\": \"Transaction ID is required.\"}", "application/json");
+            return;
+        }
+
+        tx_proof proof;
+        int result = get_transaction_proof(tx_id, &proof);
+        if (result == 1) {
+            res.status = 404;
+            res.set_content("{\"success\": false, \"message\": \"Transaction not found (or not sealed yet).\"}", "application/json");
+            return;
+        }
+        if (result != 0) {
+            res.status = 503;
+            res.set_content("{\"success\": false, \"message\": \"Ledger is out of memory.\"}", "application/json");
+            return;
+        }
+
+        std::ostringstream out;
+        out << "{\"success\": true, \"txID\": " << proof.txID
+            << ", \"from\": " << proof.fromAcc << ", \"to\": " << proof.toAcc
+            << ", \"amount\": " << proof.amount
+            << ", \"block\": " << proof.blockIndex
+            << ", \"leafIndex\": " << proof.leafIndex << ", \"leafCount\": " << proof.leafCount
+            << ", \"leafData\": \"" << to_hex(proof.leafData, (size_t)proof.leafDataLen) << "\""
+            << ", \"leaf\": \"" << to_hex(proof.leaf, PROOF_HASH_LEN) << "\""
+            << ", \"proof\": [";
+        for (int i = 0; i < proof.steps; i++) {
+            out << (i ? ", " : "") << "{\"hash\": \"" << to_hex(proof.siblings[i], PROOF_HASH_LEN)
+                << "\", \"side\": \"" << (proof.siblingOnLeft[i] ? "left" : "right") << "\"}";
+        }
+        out << "], \"merkleRoot\": \"" << to_hex(proof.merkleRoot, PROOF_HASH_LEN) << "\""
+            << ", \"header\": \"" << to_hex(proof.header, PROOF_HEADER_LEN) << "\""
+            << ", \"blockHash\": \"" << to_hex(proof.blockHash, PROOF_HASH_LEN) << "\"}";
+        res.set_content(out.str(), "application/json");
+    });
+
+    // --- Admin: background snapshots ---
+    svr.Post("/api/admin/snapshot", [](const httplib::Request &req, httplib::Response &res) {
+        int result = start_snapshot();
+        if (result == 0) {
+            res.status = 202;
+            res.set_content("{\"success\": true, \"message\": \"Snapshot started.\"}", "application/json");
+        } else if (result == 1) {
+            res.status = 409;
+            res.set_content("{\"success\": false, \"message\": \"A snapshot is already in progress.\"}", "application/json");
+        } else {
+            res.status = 501;
+            res.set_content("{\"success\": false, \"message\": \"Snapshots are not available on this platform.\"}", "application/json");
         }
     });
 
+    svr.Get("/api/admin/snapshot", [](const httplib::Request &req, httplib::Response &res) {
+        snapshot_stats stats;
+        if (get_snapshot_stats(&stats) != 0) {
+            res.status = 501;
+            res.set_content("{\"success\": false, \"message\": \"Snapshots are not available on this platform.\"}", "application/json");
+            return;
+        }
+        std::ostringstream out;
+        out << "{\"success\": true, \"running\": " << (stats.running ? "true" : "false")
+            << ", \"snapshots\": " << stats.snapshots << ", \"failures\": " << stats.failures
+            << ", \"lastMs\": " << stats.lastMs << ", \"lastPauseMs\": " << stats.lastPauseMs
+            << ", \"lastCowPages\": " << stats.lastCowPages << ", \"lastCowBytes\": " << stats.lastCowBytes << "}";
+        res.set_content(out.str(), "application/json");
+    });
+
     // 3. Serve Static Frontend Files
     const char* web_root = "./www";
     if (!svr.set_mount_point("/", web_root)) {
@@ -279,6 +878,7 @@ int main(void) {
 
     svr.listen("localhost", 8080);
 
+    shutdown_system();
     std::cout << "Server stopped." << std::endl;
     return 0;
 }
\ No newline at end of file